@@ -404,4 +404,130 @@ void ReaderWriterLock::writeAcquire()
 void ReaderWriterLock::writeRelease()
 {
     writeLock->Release();
-}
\ No newline at end of file
+}
+//----------------------------------------------------------------------
+// Mailbox::Mailbox
+// 	Initialize an empty mailbox, with room for "ringSize" messages.
+//----------------------------------------------------------------------
+
+Mailbox::Mailbox(char* debugName, int ringSize)
+{
+    ASSERT(ringSize > 0);
+    name = debugName;
+    size = ringSize;
+    ring = new Message[size];
+    head = tail = 0;
+    receiver = NULL;
+    senders = new List;
+    sending = 0;
+    closed = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Mailbox::~Mailbox
+// 	De-allocate a mailbox.  Only called through Close, once the
+//	owner is gone and no sender is left inside Send.
+//----------------------------------------------------------------------
+
+Mailbox::~Mailbox()
+{
+    delete senders;
+    delete [] ring;
+}
+
+//----------------------------------------------------------------------
+// Mailbox::Send
+// 	Put msgs[0..n-1] in the ring, stamped with the sender's tid.  As
+//	many as fit go in at once, and the owner is woken up once for 
+//	the lot.  If the ring is full, wait for room when "wait", or 
+//	else stop there.  Returns how many messages went in.
+//
+//	If the owner finishes while we wait, stop and return how many
+//	went in before that, or -1 if none did; the last sender out of a
+//	closed mailbox deletes it.
+//----------------------------------------------------------------------
+
+int
+Mailbox::Send(Message *msgs, int n, bool wait)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    int sent = 0;
+    bool last;
+
+    sending++;
+    while (sent < n && !closed) {
+        while (sent < n && tail - head < (unsigned int)size) {
+            ring[tail % size] = msgs[sent];
+            ring[tail % size].srcId = currentThread->getTid();
+            tail++;
+            sent++;
+        }
+        if (receiver != NULL) {			// something to read now
+            scheduler->ReadyToRun(receiver);
+            receiver = NULL;
+        }
+        if (sent == n || !wait)
+            break;
+        senders->Append((void *)currentThread);	// full, wait for room
+        currentThread->Sleep();
+    }
+    sending--;
+    if (closed && sent == 0)
+        sent = -1;
+    last = closed && sending == 0;
+    (void) interrupt->SetLevel(oldLevel);
+    if (last)
+        delete this;
+    return sent;
+}
+
+//----------------------------------------------------------------------
+// Mailbox::Receive
+// 	Take up to "max" messages out of the ring, oldest first.  If it
+//	is empty, wait for at least one when "wait", or else return 0.
+//	Everybody waiting for room is woken up, to try again.
+//----------------------------------------------------------------------
+
+int
+Mailbox::Receive(Message *msgs, int max, bool wait)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Thread *thread;
+    int got = 0;
+
+    while (head == tail && wait) {
+        receiver = currentThread;
+        currentThread->Sleep();
+    }
+    while (got < max && head != tail)
+        msgs[got++] = ring[head++ % size];
+    if (got > 0)
+        while ((thread = (Thread *)senders->Remove()) != NULL)
+            scheduler->ReadyToRun(thread);
+    (void) interrupt->SetLevel(oldLevel);
+    return got;
+}
+
+//----------------------------------------------------------------------
+// Mailbox::Close
+// 	The owner has finished.  Wake up everybody waiting for room, so
+//	that their Send returns; messages still in the ring are dropped.
+//	Delete the mailbox now if nobody is inside Send, or else leave
+//	that to the last one out.
+//----------------------------------------------------------------------
+
+void
+Mailbox::Close()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Thread *thread;
+    bool idle;
+
+    closed = TRUE;
+    while ((thread = (Thread *)senders->Remove()) != NULL)
+        scheduler->ReadyToRun(thread);
+    idle = (sending == 0);
+    (void) interrupt->SetLevel(oldLevel);
+    if (idle)
+        delete this;
+}
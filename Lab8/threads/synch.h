@@ -21,7 +21,7 @@
 #include "thread.h"
 #include "list.h"
 
-#define MaxMessageLen 32
+#define MailboxSize 32			// messages a mailbox can hold
 
 // The following class defines a "semaphore" whose value is a non-negative
 // integer.  The semaphore has only two operations P() and V():
@@ -208,12 +208,36 @@ class ReaderWriterLock {
     Lock* writeLock;
 };
 
-class MessQueue {
+// The following class defines a thread's mailbox: a ring of message
+// descriptors.  Only the owner receives, any thread may send.  Each
+// send or receive moves a whole batch with interrupts off just once,
+// and no lock is taken, so there is nothing to contend for.  A receiver
+// finding the ring empty, or a sender finding it full, sleeps (if it
+// asked to wait) until the other side has made progress.  When the
+// owner goes away, Close wakes any blocked senders; the mailbox itself
+// is deleted by whoever leaves it last.
+
+class Mailbox {
   public:
-    MessQueue() { messLock = new Lock("Message Queue Lock"); } 
-    ~MessQueue() { delete messLock; } 
-    MessageItem messages[MaxMessageLen];
-    Lock *messLock;
+    Mailbox(char* debugName, int ringSize);
+    ~Mailbox();
+
+    int Send(Message *msgs, int n, bool wait);	// returns how many sent
+    int Receive(Message *msgs, int max, bool wait); // owner only; returns
+    						// how many received
+    void Close();				// owner is gone; deletes the
+    						// mailbox once no one is in Send
+
+  private:
+    char* name;
+    Message *ring;
+    int size;
+    unsigned int head, tail;		// next to receive, next free slot;
+					// the ring holds tail - head messages
+    Thread *receiver;			// owner, if asleep waiting for mail
+    List *senders;			// threads waiting for room
+    int sending;			// threads inside Send
+    bool closed;			// owner has finished
 };
 
 #endif // SYNCH_H
\ No newline at end of file
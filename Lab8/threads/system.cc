@@ -35,8 +35,6 @@ Machine *machine;	// user program memory and registers
 PostOffice *postOffice;
 #endif
 
-MessQueue MQ;
-
 // External definition, to allow us to take a pointer to this function
 extern void Cleanup();
 
@@ -150,9 +148,6 @@ Initialize(int argc, char **argv)
         threadIdPool.push(i);
     }
 
-    for (int i = 0; i < MaxMessageLen; i++)
-        MQ.messages[i].valid = false;
-
     threadToBeDestroyed = NULL;
 
     // We didn't explicitly allocate the current thread we are running in.
@@ -62,4 +62,3 @@ extern PostOffice* postOffice;
 
 #endif // SYSTEM_H
 
-extern MessQueue MQ;
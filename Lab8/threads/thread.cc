@@ -57,6 +57,7 @@ Thread::Thread(char* threadName)
     stackTop = NULL;
     stack = NULL;
     status = JUST_CREATED;         
+    mailbox = NULL;
 #ifdef USER_PROGRAM
     space = NULL;
 #endif
@@ -81,6 +82,7 @@ Thread::Thread(char* threadName, int _pri) : priority(min(max(_pri, 0), MAX_PRIO
     stackTop = NULL;
     stack = NULL;
     status = JUST_CREATED;         
+    mailbox = NULL;
 #ifdef USER_PROGRAM
     space = NULL;
 #endif
@@ -113,6 +115,8 @@ Thread::~Thread()
     ASSERT(this != currentThread);
     if (stack != NULL)
 	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+    if (mailbox != NULL)
+        mailbox->Close();		// senders may still be blocked on it
 
     threadPtrVec[tid] = NULL;
     threadIdPool.push(tid);
@@ -341,42 +345,51 @@ Thread::StackAllocate (VoidFunctionPtr func, void *arg)
     machineState[WhenDonePCState] = (int*)ThreadFinish;
 }
 
-bool Thread::sendMess(char *buf, int size, int dstId)
+//----------------------------------------------------------------------
+// Thread::getMailbox
+// 	Return the thread's mailbox, making it the first time.
+//----------------------------------------------------------------------
+
+Mailbox *
+Thread::getMailbox()
 {
-    if (size < 0 || size > 512) {
-        DEBUG('M', "Error message length!\n");
-        return false;
-    }
-    MQ.messLock->Acquire();
-    for (int i = 0; i < MaxMessageLen; i++)
-        if (!MQ.messages[i].valid) {
-            MQ.messages[i].valid = true;
-            MQ.messages[i].dstId = dstId;
-            MQ.messages[i].srcId = currentThread->getTid();
-            MQ.messages[i].len = size;
-            for (int j = 0; j < size; j++)
-                MQ.messages[i].mess[j] = buf[j];
-            MQ.messLock->Release();
-            return true;
-        }
-    MQ.messLock->Release();
-    return false;
+    if (mailbox == NULL)
+        mailbox = new Mailbox(name, MailboxSize);
+    return mailbox;
 }
 
-int Thread::recvMess(char *buf)
+//----------------------------------------------------------------------
+// Thread::sendMess
+// 	Send msgs[0..n-1] to thread "dstId".  Only the descriptors are
+//	copied; the receiver gets the same "data" pointers.  If the 
+//	receiver's mailbox fills up, wait for room, unless !wait.
+//	Returns how many messages were sent, or -1 if "dstId" is not a
+//	live thread, or finishes before taking any of them.
+//----------------------------------------------------------------------
+
+int
+Thread::sendMess(Message *msgs, int n, int dstId, bool wait)
 {
-    MQ.messLock->Acquire();
-    for (int i = 0; i < MaxMessageLen; i++) {
-        if (MQ.messages[i].valid && MQ.messages[i].dstId == currentThread->getTid()) {
-            int size = MQ.messages[i].len;
-            memcpy(buf, MQ.messages[i].mess, size);
-            MQ.messages[i].valid = false;
-            MQ.messLock->Release();
-            return size;
-        }
+    Thread *dst;
+
+    if (dstId < 0 || dstId >= MAX_TID || (dst = threadPtrVec[dstId]) == NULL) {
+        DEBUG('M', "No thread %d to send to!\n", dstId);
+        return -1;
     }
-    MQ.messLock->Release();
-    return -1;
+    return dst->getMailbox()->Send(msgs, n, wait);
+}
+
+//----------------------------------------------------------------------
+// Thread::recvMess
+// 	Receive up to "max" messages sent to this thread.  If there are
+//	none, wait for one, unless !wait.  Returns how many arrived.
+//----------------------------------------------------------------------
+
+int
+Thread::recvMess(Message *msgs, int max, bool wait)
+{
+    ASSERT(this == currentThread);
+    return getMailbox()->Receive(msgs, max, wait);
 }
 
 #ifdef USER_PROGRAM
@@ -68,6 +68,9 @@ extern std::queue<int> threadIdPool;
 // external function, dummy routine whose sole job is to call Thread::Print
 extern void ThreadPrint(int arg);
 
+class Message;
+class Mailbox;
+
 // The following class defines a "thread control block" -- which
 // represents a single thread of execution.
 //
@@ -146,8 +149,20 @@ class Thread {
     bool checkRunningTime() { return timeTicks >= timeSlice; }
     void clearTicks() { timeTicks = 0; }
 
-    bool sendMess(char *buf, int size, int dstId);
-    int recvMess(char *buf);
+    // message passing; each thread has a mailbox (cf. synch.h),
+    // made the first time someone sends to it or it receives
+    int sendMess(Message *msgs, int n, int dstId, bool wait = TRUE);
+    					// queue msgs[0..n-1] for "dstId";
+					// returns how many were queued, 
+					// -1 if there is no such thread
+    int recvMess(Message *msgs, int max, bool wait = TRUE);
+    					// take up to "max" messages, in
+					// the order they were sent; returns
+					// how many (0 only if !wait)
+    Mailbox *getMailbox();
+
+  private:
+    Mailbox *mailbox;			// NULL until first used
 
 #ifdef USER_PROGRAM
 // A thread running a user program actually has *two* sets of CPU registers -- 
@@ -179,13 +194,15 @@ void SWITCH(Thread *oldThread, Thread *newThread);
 }
 
 
-class MessageItem{
+// A message is passed by reference: only this descriptor is copied,
+// into and out of the receiver's mailbox.  "data" belongs to the 
+// receiver once the message has been received.
+
+class Message {
   public:
-    bool valid;
-    int srcId;
-    int dstId;
-    char mess[512];
-    int len;
+    int srcId;				// tid of the sender, filled in by send
+    int len;				// bytes at "data"
+    char *data;
 };
 
 #endif // THREAD_H
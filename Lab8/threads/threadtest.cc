@@ -12,6 +12,7 @@
 #include "copyright.h"
 #include "system.h"
 #include "elevatortest.h"
+#include <sys/time.h>
 #ifndef FILESYS
     #include "synch.h"
 #endif
@@ -310,18 +311,171 @@ void ThreadTestInLab3Challenge2()
 
 void ReceiveMessage(int which)
 {
-    char buffer[512];
-    int len = currentThread->recvMess(buffer);
+    Message msg;
 
-    printf("Receive message of length %d: %s", len, buffer);
+    currentThread->recvMess(&msg, 1);
+    printf("Receive message of length %d from %d: %s", msg.len, msg.srcId, 
+        msg.data);
 }
 
 void ThreadTestInLab8()
 {
     Thread *newThread = new Thread("Test");
+    Message msg;
+
     newThread->Fork(ReceiveMessage, 0);
+    msg.data = "Hello world!\n";
+    msg.len = 14;
+    currentThread->sendMess(&msg, 1, newThread->getTid());
+}
+
+//----------------------------------------------------------------------
+// ThreadTestInMessageRate
+// 	Message passing benchmark.  First two threads bounce one message
+//	back and forth PingPongRounds times; then FanInSenders threads 
+//	each send FanInMessages to one receiver, FanInBatch at a time,
+//	and the receiver takes whatever has arrived in one call.  Print
+//	messages per host second, and simulated ticks per message.
+//----------------------------------------------------------------------
+
+#define PingPongRounds	10000
+#define FanInSenders	4
+#define FanInMessages	10000
+#define FanInBatch	8
+
+static int pingTid, pongTid;
+static double rateStart;
+static int tickStart;
+
+static double
+HostSeconds()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void
+PrintRate(char *what, int messages)
+{
+    double seconds = HostSeconds() - rateStart;
+
+    printf("%s: %d messages, %.0f per host second, %.1f ticks each\n", 
+        what, messages, seconds > 0 ? messages / seconds : 0.0,
+        (double)(stats->totalTicks - tickStart) / messages);
+}
+
+void FanInSender(int which)
+{
+    Message batch[FanInBatch];
+
+    for (int i = 0; i < FanInMessages; i += FanInBatch) {
+        for (int j = 0; j < FanInBatch; j++) {
+            batch[j].data = NULL;
+            batch[j].len = 0;
+        }
+        currentThread->sendMess(batch, FanInBatch, pingTid);
+    }
+}
+
+void FanInTest()
+{
+    Message batch[MailboxSize];
+    int total = FanInSenders * FanInMessages;
+
+    rateStart = HostSeconds();
+    tickStart = stats->totalTicks;
+    for (int i = 0; i < FanInSenders; i++)
+        (new Thread("fan-in sender"))->Fork(FanInSender, (void *)i);
+    for (int got = 0; got < total; )
+        got += currentThread->recvMess(batch, MailboxSize);
+    PrintRate("fan-in", total);
+}
+
+void PongThread(int which)
+{
+    Message msg;
+
+    for (int i = 0; i < PingPongRounds; i++) {
+        currentThread->recvMess(&msg, 1);
+        currentThread->sendMess(&msg, 1, msg.srcId);
+    }
+}
 
-    currentThread->sendMess("Hello world!\n", 14, newThread->getTid());
+void PingThread(int which)
+{
+    Message msg;
+
+    rateStart = HostSeconds();
+    tickStart = stats->totalTicks;
+    msg.data = NULL;
+    msg.len = 0;
+    for (int i = 0; i < PingPongRounds; i++) {
+        currentThread->sendMess(&msg, 1, pongTid);
+        currentThread->recvMess(&msg, 1);
+    }
+    PrintRate("ping-pong", 2 * PingPongRounds);
+    FanInTest();
+}
+
+void ThreadTestInMessageRate()
+{
+    DEBUG('t', "Enter ThreadTestInMessageRate");
+
+    Thread *ping = new Thread("ping");
+    Thread *pong = new Thread("pong");
+
+    pingTid = ping->getTid();
+    pongTid = pong->getTid();
+    pong->Fork(PongThread, (void *)1);
+    ping->Fork(PingThread, (void *)0);
+}
+
+//----------------------------------------------------------------------
+// ThreadTestInDeadReceiver
+// 	Two threads block sending to a full mailbox, and then its owner
+//	exits without ever receiving.  Both sends must return: the one
+//	that filled the ring with a short count, the other with -1.
+//----------------------------------------------------------------------
+
+static int deadTid;
+static int deadSendersDone;
+
+void DeadReceiver(int which)
+{
+    currentThread->Yield();		// let both senders block first
+}
+
+void DeadSender(int which)
+{
+    Message batch[MailboxSize + 2];
+    int n = (which == 0) ? MailboxSize + 2 : 1;
+
+    for (int i = 0; i < n; i++) {
+        batch[i].data = NULL;
+        batch[i].len = 0;
+    }
+    printf("sender %d: sent %d of %d\n", which, 
+        currentThread->sendMess(batch, n, deadTid), n);
+    deadSendersDone++;
+}
+
+void ThreadTestInDeadReceiver()
+{
+    DEBUG('t', "Enter ThreadTestInDeadReceiver");
+
+    Thread *receiver = new Thread("dead receiver");
+
+    deadTid = receiver->getTid();
+    deadSendersDone = 0;
+    receiver->Fork(DeadReceiver, (void *)0);
+    (new Thread("dead sender 0"))->Fork(DeadSender, (void *)0);
+    (new Thread("dead sender 1"))->Fork(DeadSender, (void *)1);
+    while (deadSendersDone < 2)
+        currentThread->Yield();
+    printf("main: send to the exited receiver returned %d\n", 
+        currentThread->sendMess(NULL, 0, deadTid));
 }
 
 //----------------------------------------------------------------------
@@ -369,6 +523,12 @@ ThreadTest()
     case 12:
         ThreadTestInLab8();
         break;
+    case 13:
+        ThreadTestInMessageRate();
+        break;
+    case 14:
+        ThreadTestInDeadReceiver();
+        break;
     default:
 	    printf("No test specified.\n");
 	    break;
@@ -64,6 +64,8 @@ FileHeader::Allocate(BitMap *freeMap, int fileSize, fileType FileType)
         int j = 0;
         int index[NumIndirect];
         while (unassignedSectors != 0){
+            if (j == NumIndirect)
+                return FALSE;		// bigger than MaxFileSize
             index[j] = freeMap->Find();
             if (index[j] == -1)
                 return FALSE;
@@ -77,8 +79,6 @@ FileHeader::Allocate(BitMap *freeMap, int fileSize, fileType FileType)
             synchDisk->WriteSector(index[j], (char *)sectors);
             unassignedSectors -= indexSectors;
             j++;
-            if (j == NumIndirect)
-                return FALSE;
         }
         synchDisk->WriteSector(dataSectors[NumDirect], (char *) index);
     }
@@ -306,66 +306,65 @@ FileHeader::getPath(char *into)
     delete pathFile;
 }
 
+//----------------------------------------------------------------------
+// FileHeader::Expand
+// 	Make the file "fileSize" bytes long, allocating the sectors that 
+//	takes on top of the ones it has.  Each new sector is the first
+//	free one after the one before it, so that a file that grows a lot
+//	at once gets a run of consecutive sectors.  The index sectors for
+//	the new sectors come after the sectors they index.  Return FALSE,
+//	having changed nothing, if there isn't room.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"fileSize" is the new length of the file
+//----------------------------------------------------------------------
+
 bool
 FileHeader::Expand(BitMap *freeMap, int fileSize)
 {
     ASSERT(fileSize > numBytes);
 
-    numBytes = fileSize;
-    int numNewSectors  = divRoundUp(fileSize, SectorSize);
-
-    DEBUG('f', "Expand File!\n");
-    if (numNewSectors == numSectors)
-        return TRUE;
-
-    int unassignedSectors = numNewSectors;
-    if (unassignedSectors > NumDirect) {
-        for (int i = 0; i < NumDirect; i++) {
-            if (numNewSectors - unassignedSectors >= numSectors)
-                dataSectors[i] = freeMap->Find();
-            if (dataSectors[i] == -1)
-                return FALSE;
-            unassignedSectors--;
-        }
-        
-        if (numNewSectors - unassignedSectors >= numSectors)
-            dataSectors[NumDirect] = freeMap->Find();
-        if (dataSectors[NumDirect] == -1)
-            return FALSE;
-
-        int j = 0;
+    int numNewSectors = divRoundUp(fileSize, SectorSize);
+    int oldIndexes = (numSectors > NumDirect) 
+			? divRoundUp(numSectors - NumDirect, NumIndirect) : 0;
+    int newIndexes = (numNewSectors > NumDirect) 
+			? divRoundUp(numNewSectors - NumDirect, NumIndirect) : 0;
+    int needed = (numNewSectors - numSectors) + (newIndexes - oldIndexes)
+			+ ((oldIndexes == 0 && newIndexes > 0) ? 1 : 0);
+    int last = (numSectors > 0) ? ByteToSector((numSectors - 1) * SectorSize) 
+			: -1;			// the sector to allocate after
+    int k = numSectors;
+
+    DEBUG('f', "Expand file from %d to %d bytes, %d new sectors\n", 
+			numBytes, fileSize, needed);
+    if (newIndexes > NumIndirect || freeMap->NumClear() < needed)
+        return FALSE;
+
+    for (; k < numNewSectors && k < NumDirect; k++)
+        dataSectors[k] = last = freeMap->FindAfter(last);
+    if (k < numNewSectors) {
         int index[NumIndirect];
-        while (unassignedSectors != 0){
-            if (numNewSectors - unassignedSectors >= numSectors)
-                index[j] = freeMap->Find();
-            if (index[j] == -1)
-                return FALSE;
 
-            int indexSectors = unassignedSectors > NumIndirect ? NumIndirect : unassignedSectors;
-            int sectors[NumIndirect];	
-            for (int i = 0; i < indexSectors; i++) {
-                if (numNewSectors - unassignedSectors >= numSectors)
-                    sectors[i] = freeMap->Find();
-                if (sectors[i] == -1)
-                    return FALSE;
-                unassignedSectors--;
-            }
-            synchDisk->WriteSector(index[j], (char *)sectors);
-            j++;
-            if (j == NumIndirect)
-                return FALSE;
+        if (oldIndexes > 0)
+            synchDisk->ReadSector(dataSectors[NumDirect], (char *) index);
+        while (k < numNewSectors) {
+            int j = (k - NumDirect) / NumIndirect;
+            int sectors[NumIndirect];
+
+            if (j < oldIndexes)
+                synchDisk->ReadSector(index[j], (char *) sectors);
+            for (; k < numNewSectors && (k - NumDirect) / NumIndirect == j; k++)
+                sectors[(k - NumDirect) % NumIndirect] = last 
+						= freeMap->FindAfter(last);
+            if (j >= oldIndexes)
+                index[j] = last = freeMap->FindAfter(last);
+            synchDisk->WriteSector(index[j], (char *) sectors);
         }
+        if (oldIndexes == 0)
+            dataSectors[NumDirect] = freeMap->FindAfter(last);
         synchDisk->WriteSector(dataSectors[NumDirect], (char *) index);
     }
-    else {
-        for (int i = 0; i < numNewSectors; i++) {
-            if (numNewSectors - unassignedSectors >= numSectors)
-                dataSectors[i] = freeMap->Find();
-            if (dataSectors[i] == -1)
-                return FALSE;
-            unassignedSectors--;
-        }
-    }
+    numBytes = fileSize;
     numSectors = numNewSectors;
     return TRUE;
 }
\ No newline at end of file
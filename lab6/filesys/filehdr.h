@@ -22,8 +22,13 @@ enum fileType {NormalFile, DirectoryFile, BitMapFile, NameFile, PathFile};
 #define TimeLength  24
 #define MaxPathLength   10
 #define NumDirect 	(((SectorSize - 4 * sizeof(int) - sizeof(fileType) - 3 * (TimeLength+1) * sizeof(char)) / sizeof(int)) - 1)
-#define MaxFileSize 	(NumDirect * SectorSize)
 #define NumIndirect  (SectorSize / sizeof(int))
+#define MaxFileSize 	((NumDirect + NumIndirect * NumIndirect) * SectorSize)
+				// 131968 bytes with 128-byte sectors,
+				// about 8MB with 512-byte ones
+#define IndexSectors(bytes) (divRoundUp(bytes, NumIndirect * SectorSize) + 1)
+				// index sectors that giving a file this
+				// many more bytes may write
 
 // The following class defines the Nachos "file header" (in UNIX terms,  
 // the "i-node"), describing where on disk to find all of the data in the file.
@@ -34,7 +39,10 @@ enum fileType {NormalFile, DirectoryFile, BitMapFile, NameFile, PathFile};
 // When it is on disk, it is stored in a single sector -- this means
 // that we assume the size of this data structure to be the same
 // as one disk sector.  Without indirect addressing, this
-// limits the maximum file length to just under 4K bytes.
+// limits the maximum file length to just under 4K bytes.  The last
+// pointer in the header names a sector of NumIndirect index sectors,
+// each of NumIndirect data sectors, so a file can grow to MaxFileSize:
+// far less than a disk can hold, whatever its geometry.
 //
 // There is no constructor; rather the file header can be initialized
 // by allocating blocks for the file (if it is a new file), or by
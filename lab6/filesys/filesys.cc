@@ -30,14 +30,17 @@
 //
 // 	Our implementation at this point has the following restrictions:
 //
-//	   there is no synchronization for concurrent accesses
+//	   changes to the directories and the bitmap are serialized, but
+//	     there is no other synchronization for concurrent accesses
 //	   files have a fixed size, set when the file is created
 //	   files cannot be bigger than about 3KB in size
 //	   there is no hierarchical directory structure, and only a limited
 //	     number of files can be added to the system
-//	   there is no attempt to make the system robust to failures
-//	    (if Nachos exits in the middle of an operation that modifies
-//	    the file system, it may corrupt the disk)
+//
+//	Operations that modify the directory, bitmap or file headers are
+//	journaled (cf. synchdisk.h), so that if Nachos exits in the middle
+//	of one, it is either all there or not there at all, once the log
+//	is replayed on the next mount.  File data is not journaled.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -54,9 +57,11 @@
 
 // Sectors containing the file headers for the bitmap of free sectors,
 // and the directory of files.  These file headers are placed in well-known 
-// sectors, so that they can be located on boot-up.
+// sectors, so that they can be located on boot-up.  The metadata log 
+// comes right after them.
 #define FreeMapSector 		0
 #define DirectorySector 	1
+#define JournalSector		2
 
 // Initial file sizes for the bitmap and directory; until the file system
 // supports extensible files, the directory size sets the maximum number 
@@ -75,7 +80,8 @@ void setPathFile(char *path, char *name, FileHeader *directoryHdr, fileType type
 //	not all of the sectors marked as free).  
 //
 //	If format = FALSE, we just have to open the files
-//	representing the bitmap and the directory.
+//	representing the bitmap and the directory, once the log has
+//	been replayed.
 //
 //	"format" -- should we initialize the disk?
 //----------------------------------------------------------------------
@@ -83,6 +89,8 @@ void setPathFile(char *path, char *name, FileHeader *directoryHdr, fileType type
 FileSystem::FileSystem(bool format)
 { 
     DEBUG('f', "Initializing the file system.\n");
+    changeLock = new Lock("file system change lock");
+    createMap = NULL;
     if (format) {
         BitMap *freeMap = new BitMap(NumSectors);
         Directory *directory = new Directory(NumDirEntries);
@@ -96,6 +104,8 @@ FileSystem::FileSystem(bool format)
         // (make sure no one else grabs these!)
         freeMap->Mark(FreeMapSector);	    
         freeMap->Mark(DirectorySector);
+        for (int i = 0; i < JournalSectors; i++)
+            freeMap->Mark(JournalSector + i);
 
         // Second, allocate space for the data blocks containing the contents
         // of the directory and bitmap files.  There better be enough space!
@@ -161,9 +171,12 @@ FileSystem::FileSystem(bool format)
         delete directory; 
         delete mapHdr; 
         delete dirHdr;
+        (void) synchDisk->StartJournal(JournalSector, TRUE);
     } else {
     // if we are not formatting the disk, just open the files representing
     // the bitmap and directory; these are left open while Nachos is running
+        if (!synchDisk->StartJournal(JournalSector, FALSE))
+            DEBUG('f', "No journal on the disk.\n");
         freeMapFile = new OpenFile(FreeMapSector);
         directoryFile = new OpenFile(DirectorySector);
     }
@@ -194,6 +207,8 @@ FileSystem::FileSystem(bool format)
 // 	Note that this implementation assumes there is no concurrent access
 //	to the file system!
 //
+//	It is all one journaled operation, done holding changeLock.
+//
 //	"name" -- name of file to be created
 //	"initialSize" -- size of file to be created
 //----------------------------------------------------------------------
@@ -215,6 +230,9 @@ FileSystem::Create(char *path, int initialSize)
         printf("\nPath Error!\n");
         return FALSE;
     }
+    synchDisk->BeginOp(IndexSectors(initialSize == -1 ? DirectoryFileSize 
+							: initialSize));
+    changeLock->Acquire();
     FileHeader *dictHdr = new FileHeader;
     dictHdr->FetchFrom(dictHdrSector);
     OpenFile *dictFile = new OpenFile(dictHdrSector);
@@ -238,21 +256,27 @@ FileSystem::Create(char *path, int initialSize)
 
     freeMap = new BitMap(NumSectors);
     freeMap->FetchFrom(freeMapFile);
+    createMap = freeMap;		// the directory and its name file
+					// grow from it too
 
+    success = TRUE;
     int nameFileSector = -1;
     if (type == DirectoryFile) {
+        FileHeader *nameFileHdr = new FileHeader;
+
         nameFileSector = freeMap->Find();
         if (nameFileSector == -1)
-            return FALSE;
-        FileHeader *nameFileHdr = new FileHeader;
-        if (nameFileHdr->Allocate(freeMap, SectorSize, NameFile) == FALSE)
-            return FALSE;
-        nameFileHdr->WriteBack(nameFileSector);
+            success = FALSE;		// no free block for its name file
+        else if (nameFileHdr->Allocate(freeMap, SectorSize, NameFile) == FALSE)
+            success = FALSE;
+        else
+            nameFileHdr->WriteBack(nameFileSector);
         delete nameFileHdr;
     }
 
-    if (directory->Find(name) != -1)
-        success = FALSE;			// file is already in directory
+    if (!success || directory->Find(name) != -1)
+        success = FALSE;		// no room for the name file, or the
+					// file is already in directory
     else {
         sector = freeMap->Find();	// find a sector to hold the file header
         pathFileSector = freeMap->Find();
@@ -277,11 +301,6 @@ FileSystem::Create(char *path, int initialSize)
                 hdr->setLastModifyTime();
                 hdr->setPath(pathFileSector, dictHdr->getPathLength() + strlen(name) + (type == DirectoryFile));
 
-                if (type == NormalFile)  {
-                    synchDisk->hdrLocks[sector] = new ReaderWriterLock("file ReaderWriterLock");
-                    synchDisk->openFileCount[sector] = 0;
-                }
-
                 hdr->WriteBack(sector);
                 pathFileHdr->WriteBack(pathFileSector); 		
                 directory->WriteBack(dictFile);
@@ -310,6 +329,9 @@ FileSystem::Create(char *path, int initialSize)
             delete hdr;
 	    }
     }
+    createMap = NULL;
+    changeLock->Release();
+    synchDisk->EndOp();
     delete freeMap;
     delete directory;
     delete dictFile;
@@ -353,12 +375,8 @@ FileSystem::Open(char *path)
     directory->FetchFrom(dictFile);
     sector = directory->Find(name); 
     if (sector >= 0) {
-        synchDisk->countLock[sector]->Acquire();
-        if (synchDisk->openFileCount[sector] != -1) {
-            synchDisk->openFileCount[sector]++;
+        if (synchDisk->HeaderOpened(sector))
 	        openFile = new OpenFile(sector);	// name was found in directory 
-        }
-        synchDisk->countLock[sector]->Release();
     }
     delete directory;
     delete dictFile;
@@ -384,7 +402,8 @@ FileSystem::Open(char *path)
 //	    Write changes to directory, bitmap back to disk
 //
 //	Return TRUE if the file was deleted, FALSE if the file wasn't
-//	in the file system.
+//	in the file system.  It is all one journaled operation, done 
+//	holding changeLock.
 //
 //	"name" -- the text name of the file to be removed
 //----------------------------------------------------------------------
@@ -402,6 +421,8 @@ FileSystem::Remove(char *path)
         printf("\nPath Error!\n");
         return FALSE;
     }
+    synchDisk->BeginOp();
+    changeLock->Acquire();
     FileHeader *dictHdr = new FileHeader;
     dictHdr->FetchFrom(dictHdrSector);
     OpenFile *dictFile = new OpenFile(dictHdrSector);
@@ -417,6 +438,8 @@ FileSystem::Remove(char *path)
 
     sector = directory->Find(name);
     if (sector == -1) {
+       changeLock->Release();
+       synchDisk->EndOp();
        delete directory;
        delete dictFile;
        delete dictHdr;
@@ -435,6 +458,8 @@ FileSystem::Remove(char *path)
         dir->FetchFrom(file);
         if (!dir->isEmpty()) {
             printf("Can't remove directory which is not empty!\n");
+            changeLock->Release();
+            synchDisk->EndOp();
             delete dir;
             delete file;
             delete freeMap;
@@ -452,20 +477,16 @@ FileSystem::Remove(char *path)
         delete dir;
         delete file;
     } else {
-        synchDisk->countLock[sector]->Acquire();
-        if (synchDisk->openFileCount[sector] != 0) {
+        if (!synchDisk->HeaderRemoving(sector)) {
             printf("The file is being accessed, fail to remove!\n");
-            synchDisk->countLock[sector]->Release();
+            changeLock->Release();
+            synchDisk->EndOp();
             delete freeMap;
             delete directory;
             delete dictFile;
             delete dictHdr;
             return FALSE;
         }
-        synchDisk->openFileCount[sector] = -1;
-        synchDisk->countLock[sector]->Release();
-
-        delete synchDisk->hdrLocks[sector];
     }
 
     // Delete Path File
@@ -482,6 +503,9 @@ FileSystem::Remove(char *path)
 
     freeMap->WriteBack(freeMapFile);		// flush to disk
     directory->WriteBack(dictFile);        // flush to disk
+    changeLock->Release();
+    synchDisk->EndOp();
+    synchDisk->HeaderRemoved(sector);
     delete fileHdr;
     delete directory;
     delete dictFile;
@@ -592,15 +616,60 @@ FileSystem::findDict(char *path)
     }
 }
 
+//----------------------------------------------------------------------
+// FileSystem::ExpandFile
+// 	Give a file more sectors, enough for "newSize" bytes, from the
+//	bitmap; the caller writes the header back.  Holds changeLock 
+//	meanwhile, unless it already has it (a directory growing in 
+//	Create).  Then the sectors come from Create's own bitmap, which
+//	already has the ones it took; it is written back at once, so that
+//	the grown header is never ahead of the bitmap on disk.
+//----------------------------------------------------------------------
+
 bool
 FileSystem::ExpandFile(FileHeader *hdr, int newSize)
 {
     int success;
-    BitMap *freeMap = new BitMap(FreeMapFileSize);
+    bool locked = !changeLock->isHeldByCurrentThread();
+    BitMap *freeMap;
+
+    if (locked)
+        changeLock->Acquire();
+    if (!locked && createMap != NULL) {
+        success = hdr->Expand(createMap, newSize);
+        createMap->WriteBack(freeMapFile);
+    } else {
+        freeMap = new BitMap(NumSectors);
+        freeMap->FetchFrom(freeMapFile);
+        success = hdr->Expand(freeMap, newSize);
+        freeMap->WriteBack(freeMapFile);
+        delete freeMap;
+    }
+    if (locked)
+        changeLock->Release();
+
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FreeSectors
+// 	Return how many sectors the bitmap shows as free.
+//----------------------------------------------------------------------
+
+int
+FileSystem::FreeSectors()
+{
+    int count;
+    bool locked = !changeLock->isHeldByCurrentThread();
+
+    if (locked)
+        changeLock->Acquire();
+    BitMap *freeMap = new BitMap(NumSectors);
     freeMap->FetchFrom(freeMapFile);
-    success = hdr->Expand(freeMap, newSize);
-    freeMap->WriteBack(freeMapFile);
+    count = freeMap->NumClear();
     delete freeMap;
+    if (locked)
+        changeLock->Release();
 
-    return success;
+    return count;
 }
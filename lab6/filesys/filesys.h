@@ -38,6 +38,9 @@
 #include "copyright.h"
 #include "openfile.h"
 
+class Lock;
+class BitMap;
+
 #ifdef FILESYS_STUB 		// Temporarily implement file system calls as 
 				// calls to UNIX, until the real file system
 				// implementation is available
@@ -89,12 +92,17 @@ class FileSystem {
     int findDict(char *path);
 
     bool ExpandFile(FileHeader *hdr, int newSize);
+    int FreeSectors();			// how many sectors are unallocated
 
   private:
     OpenFile* freeMapFile;		// Bit map of free disk blocks,
 					// represented as a file
     OpenFile* directoryFile;		// "Root" directory -- list of 
 					// file names, represented as a file
+    Lock *changeLock;			// held while the directories and
+					// the bitmap are being changed
+    BitMap *createMap;			// the bitmap a Create holding it
+					// is allocating from, or NULL
 };
 
 #endif // FILESYS
@@ -7,6 +7,10 @@
 //	   Perftest -- a stress test for the Nachos file system
 //		read and write a really large file in tiny chunks
 //		(won't work on baseline system!)
+//	   ReaderWriterTest -- many readers and writers on one file,
+//		reporting how long each side waited for the file's lock
+//	   IOTraceSummary -- summarize a trace of disk requests
+//	   JournalTest -- concurrent creates and removes, journaled
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -108,7 +112,7 @@ Print(char *name)
 //	  PerformanceTest -- overall control, and print out performance #'s
 //----------------------------------------------------------------------
 
-#define FileName 	"TestFile"
+#define FileName 	"/TestFile"
 #define Contents 	"1234567890"
 #define ContentSize 	strlen(Contents)
 #define FileSize 	((int)(ContentSize * 5000))
@@ -118,6 +122,8 @@ FileWrite()
 {
     OpenFile *openFile;    
     int i, numBytes;
+    int start = stats->totalTicks;
+    int held = stats->numWritesHeld, flushes = stats->numWriteFlushes;
 
     printf("Sequential write of %d byte file, in %d byte chunks\n", FileSize, ContentSize);
     if (!fileSystem->Create(FileName, 0)) {
@@ -138,6 +144,9 @@ FileWrite()
 	}
     }
     delete openFile;	// close file
+    printf("Sequential write: %d ticks, %d writes held back and written in %d\n",
+	stats->totalTicks - start, stats->numWritesHeld - held, 
+	stats->numWriteFlushes - flushes);
 }
 
 static void 
@@ -146,6 +155,8 @@ FileRead()
     OpenFile *openFile;    
     char *buffer = new char[ContentSize];
     int i, numBytes;
+    int start = stats->totalTicks;
+    int hits = stats->numReadAheadHits, misses = stats->numReadAheadMisses;
 
     printf("Sequential read of %d byte file, in %d byte chunks\n", 
 	FileSize, ContentSize);
@@ -166,6 +177,11 @@ FileRead()
     }
     delete [] buffer;
     delete openFile;	// close file
+    hits = stats->numReadAheadHits - hits;
+    misses = stats->numReadAheadMisses - misses;
+    printf("Sequential read: %d ticks, read-ahead hit rate %.1f%%\n", 
+	stats->totalTicks - start, 
+	hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0);
 }
 
 void
@@ -179,6 +195,7 @@ PerformanceTest()
       printf("Perf test: unable to remove %s\n", FileName);
       return;
     }
+    synchDisk->Sync();		// so that the writes are all counted
     stats->Print();
 }
 
@@ -236,40 +253,472 @@ SynchTest()
 
 }
 
+//----------------------------------------------------------------------
+// PipeTest
+// 	One thread copies lines typed at the keyboard into a pipe, the 
+//	other prints whatever comes out of it.  Type an empty line to
+//	close the pipe; the reader then sees end of file.
+//----------------------------------------------------------------------
+
 void
 pipeRead(int which) {
-    PipeFile *pipeFile = (PipeFile *)which;
-    while(1) {
-        char in[MAXPIPELEN + 1];
-        fgets(in, MAXPIPELEN + 1, stdin);
-        pipeFile->read(in, strlen(in));
-        currentThread->Yield();
+    PipeBuffer *pipe = (PipeBuffer *)which;
+    char out[PipeSize + 1];
+    int len;
+
+    while ((len = pipe->Read(out, PipeSize)) > 0) {
+        out[len] = '\0';
+        printf("pipe output:\t%s", out);
     }
+    printf("pipe closed\n");
+    pipe->Close(FALSE);
 }
 
 void
 pipeWrite(int which) {
-    PipeFile *pipeFile = (PipeFile *)which;
-    while(1) {
-        char out[MAXPIPELEN + 1];
-        int len = pipeFile->write(out);
-        out[len] = '\0';
-        printf("pipe output:\t%s", out);
-        currentThread->Yield();
-    }
+    PipeBuffer *pipe = (PipeBuffer *)which;
+    char in[PipeSize + 1];
+
+    while (fgets(in, PipeSize + 1, stdin) != NULL && in[0] != '\n')
+        pipe->Write(in, strlen(in));
+    pipe->Close(TRUE);
 }
 
 void
 PipeTest()
 {
-    PipeFile *pipeFile = new PipeFile("/pipeTest");
-    pipeFile->open();
+    PipeBuffer *pipe = new PipeBuffer("pipe test", PipeSize);
+    pipe->Open(FALSE);
+    pipe->Open(TRUE);
 
     Thread *t1 = new Thread("Pipe Reader");
     Thread *t2 = new Thread("Pipe Writer");
 
-    t1->Fork(pipeRead, (void *) pipeFile);
-    t2->Fork(pipeWrite, (void *) pipeFile);
+    t1->Fork(pipeRead, (void *) pipe);
+    t2->Fork(pipeWrite, (void *) pipe);
 
     return;
-}
\ No newline at end of file
+}
+
+//----------------------------------------------------------------------
+// ReaderWriterTest
+// 	Readers and writers hammer on one file at the same time.  Each
+//	writer fills the first RWBlockSize bytes with its own letter;
+//	each reader checks that it never sees a mix of two writers'
+//	letters.  At the end, print the hold and wait times of the
+//	file's ReaderWriterLock, which show whether either side starved.
+//----------------------------------------------------------------------
+
+#define RWFileName	"/rwtest"
+#define RWBlockSize	64
+#define RWReaders	4
+#define RWWriters	2
+#define RWRounds	10
+
+static int rwDone;
+
+static void
+RWReader(int which)
+{
+    OpenFile *openFile = fileSystem->Open(RWFileName);
+    char buffer[RWBlockSize];
+    ASSERT(openFile != NULL);
+
+    for (int i = 0; i < RWRounds; i++) {
+        openFile->Seek(0);
+        int readn = openFile->Read(buffer, RWBlockSize);
+        for (int j = 1; j < readn; j++)
+            if (buffer[j] != buffer[0]) {
+                printf("reader %d: torn read in round %d\n", which, i);
+                break;
+            }
+        currentThread->Yield();
+    }
+    delete openFile;
+    rwDone++;
+}
+
+static void
+RWWriter(int which)
+{
+    OpenFile *openFile = fileSystem->Open(RWFileName);
+    char buffer[RWBlockSize];
+    ASSERT(openFile != NULL);
+
+    memset(buffer, 'a' + which, RWBlockSize);
+    for (int i = 0; i < RWRounds; i++) {
+        openFile->Seek(0);
+        openFile->Write(buffer, RWBlockSize);
+        currentThread->Yield();
+    }
+    delete openFile;
+    rwDone++;
+}
+
+void
+ReaderWriterTest()
+{
+    char buffer[RWBlockSize];
+    int i;
+
+    if (!fileSystem->Create(RWFileName, 0)) {
+        printf("RW test: can't create %s\n", RWFileName);
+        return;
+    }
+    OpenFile *openFile = fileSystem->Open(RWFileName);
+    ASSERT(openFile != NULL);
+    memset(buffer, 'a', RWBlockSize);
+    openFile->Write(buffer, RWBlockSize);
+
+    rwDone = 0;
+    for (i = 0; i < RWReaders; i++)
+        (new Thread("rw reader"))->Fork(RWReader, (void *) i);
+    for (i = 0; i < RWWriters; i++)
+        (new Thread("rw writer"))->Fork(RWWriter, (void *) i);
+    while (rwDone < RWReaders + RWWriters)
+        currentThread->Yield();
+
+    synchDisk->HeaderLock(openFile->getHdrSector())->Print();
+    delete openFile;
+    if (!fileSystem->Remove(RWFileName))
+        printf("RW test: unable to remove %s\n", RWFileName);
+}
+
+//----------------------------------------------------------------------
+// DiskQueueTest
+// 	Disk scheduling benchmark.  DQThreads threads each read DQRequests
+//	random sectors straight from the disk (not through the cache), 
+//	one at a time, so that up to DQThreads requests are queued.  The
+//	same sectors are read under each disk scheduling policy, starting
+//	with the head at sector 0; print how long the head spent seeking,
+//	and how long it all took.
+//----------------------------------------------------------------------
+
+#define DQThreads	8
+#define DQRequests	32
+
+static int dqSectors[DQThreads][DQRequests];
+static Semaphore *dqDone;
+
+static void
+DQReader(int which)
+{
+    char buffer[SectorSize];
+
+    for (int i = 0; i < DQRequests; i++) {
+        DiskRequest request(dqSectors[which][i], buffer, FALSE);
+
+        synchDisk->Submit(&request);
+        synchDisk->Wait(&request);
+    }
+    dqDone->V();
+}
+
+void
+DiskQueueTest()
+{
+    static char *policyName[] = { "FCFS", "SSTF", "SCAN", "C-LOOK" };
+    DiskPolicy old = synchDisk->getPolicy();
+    char buffer[SectorSize];
+
+    RandomInit(1);
+    for (int i = 0; i < DQThreads; i++)
+        for (int j = 0; j < DQRequests; j++)
+            dqSectors[i][j] = Random() % NumSectors;
+    dqDone = new Semaphore("disk queue test", 0);
+
+    for (int p = FCFS; p <= CLOOK; p++) {
+        DiskRequest home(0, buffer, FALSE);
+
+        synchDisk->setPolicy((DiskPolicy) p);
+        synchDisk->Submit(&home);
+        synchDisk->Wait(&home);
+
+        int seekStart = stats->diskSeekTicks;
+        int start = stats->totalTicks;
+
+        for (int i = 0; i < DQThreads; i++)
+            (new Thread("disk queue reader"))->Fork(DQReader, (void *) i);
+        for (int i = 0; i < DQThreads; i++)
+            dqDone->P();
+        printf("%-6s: %d requests, seek ticks %d, total ticks %d\n", 
+            policyName[p], DQThreads * DQRequests, 
+            stats->diskSeekTicks - seekStart, stats->totalTicks - start);
+    }
+    synchDisk->setPolicy(old);
+    delete dqDone;
+}
+
+//----------------------------------------------------------------------
+// StripeTest
+// 	Striping benchmark.  For 1, 2, 4 and 8 disks, make a scratch volume
+//	of that many disks, the same size as the file system's, and time 
+//	STThreads threads each reading STRequests random stripes from it,
+//	and then one thread reading the whole volume, MaxTransfer sectors
+//	at a time.  The volumes have no cache, so every read goes to disk.
+//	Each disk of an n disk volume gets 1/n of the tracks, so n must
+//	divide NumTracks.
+//----------------------------------------------------------------------
+
+#define STThreads	8
+#define STRequests	32
+#define STVolume	"STRIPE"
+
+static SynchDisk *stVolume;
+static int stSectors[STThreads][STRequests];
+static Semaphore *stDone;
+
+static void
+STUnlink(int disks)
+{
+    char name[sizeof(STVolume) + 8];
+
+    for (int i = 0; i < disks; i++) {
+        if (disks == 1)
+            strcpy(name, STVolume);
+        else
+            sprintf(name, "%s.%d", STVolume, i);
+        Unlink(name);
+    }
+}
+
+static void
+STReader(int which)
+{
+    char buffer[StripeSectors * SectorSize];
+
+    for (int i = 0; i < STRequests; i++)
+        stVolume->ReadSectors(stSectors[which][i], buffer, StripeSectors);
+    stDone->V();
+}
+
+void
+StripeTest()
+{
+    char *buffer = new char[MaxTransfer * SectorSize];
+    int randomOne = 0, sequentialOne = 0;
+
+    RandomInit(1);
+    for (int i = 0; i < STThreads; i++)
+        for (int j = 0; j < STRequests; j++)
+            stSectors[i][j] = (Random() % (NumSectors / StripeSectors)) 
+							* StripeSectors;
+    stDone = new Semaphore("stripe test", 0);
+
+    for (int disks = 1; disks <= MaxDisks && NumTracks % disks == 0; 
+							disks *= 2) {
+        STUnlink(disks);		// left over, maybe another size
+        stVolume = new SynchDisk(STVolume, 0, disks);
+
+        int start = stats->totalTicks;
+        for (int i = 0; i < STThreads; i++)
+            (new Thread("stripe reader"))->Fork(STReader, (void *) i);
+        for (int i = 0; i < STThreads; i++)
+            stDone->P();
+        int randomTicks = stats->totalTicks - start;
+
+        start = stats->totalTicks;
+        for (int s = 0; s < NumSectors; s += MaxTransfer)
+            stVolume->ReadSectors(s, buffer, MaxTransfer);
+        int sequentialTicks = stats->totalTicks - start;
+
+        if (disks == 1) {
+            randomOne = randomTicks;
+            sequentialOne = sequentialTicks;
+        }
+        printf("%d disk(s): random %d ticks, %.1f sectors per 1000 ticks, x%.2f; "
+		"sequential %d ticks, %.1f sectors per 1000 ticks, x%.2f\n", 
+            disks, randomTicks, 
+            1000.0 * STThreads * STRequests * StripeSectors / randomTicks,
+            (double) randomOne / randomTicks,
+            sequentialTicks, 1000.0 * NumSectors / sequentialTicks,
+            (double) sequentialOne / sequentialTicks);
+
+        delete stVolume;
+        STUnlink(disks);
+    }
+    delete stDone;
+    delete [] buffer;
+}
+
+//----------------------------------------------------------------------
+// IOTraceSummary
+// 	Summarize an I/O trace written with "-iotrace": for reads and 
+//	writes, how many there were, and where their time went on 
+//	average; how busy each disk was; which threads asked for them; 
+//	and histograms of their latency, queue wait plus service.
+//----------------------------------------------------------------------
+
+#define IOSumThreads	16		// threads listed by themselves
+
+void
+IOTraceSummary(char *name)
+{
+    static const char *typeName[2] = { "reads", "writes" };
+    int fd = OpenForReadWrite(name, TRUE);
+    int header[2];
+    IOTraceRecord r;
+    int requests[2] = { 0, 0 }, sectors[2] = { 0, 0 };
+    double wait[2] = { 0, 0 }, seek[2] = { 0, 0 }, rotation[2] = { 0, 0 };
+    double service[2] = { 0, 0 };
+    int latency[2][LatencyBuckets];
+    double busy[MaxDisks];
+    int unitRequests[MaxDisks], numUnits = 0;
+    int tids[IOSumThreads], tidRequests[IOSumThreads + 1], numTids = 0;
+    double tidWait[IOSumThreads + 1];
+    int first = -1, last = 0;
+
+    Read(fd, (char *) header, sizeof(header));
+    if (header[0] != IOTraceMagic || header[1] != sizeof(IOTraceRecord)) {
+        printf("%s is not an I/O trace\n", name);
+        Close(fd);
+        return;
+    }
+    for (int i = 0; i < LatencyBuckets; i++)
+        latency[0][i] = latency[1][i] = 0;
+    for (int i = 0; i < MaxDisks; i++) {
+        busy[i] = 0;
+        unitRequests[i] = 0;
+    }
+    for (int i = 0; i <= IOSumThreads; i++) {
+        tidRequests[i] = 0;
+        tidWait[i] = 0;
+    }
+
+    while (ReadPartial(fd, (char *) &r, sizeof(r)) == sizeof(r)) {
+        int w = r.writing ? 1 : 0, t;
+        int queued = r.done - r.service - r.queueWait;
+
+        requests[w]++;
+        sectors[w] += r.count;
+        wait[w] += r.queueWait;
+        seek[w] += r.seek;
+        rotation[w] += r.rotation;
+        service[w] += r.service;
+        latency[w][LatencyBucket(r.queueWait + r.service)]++;
+        if (first < 0 || queued < first)
+            first = queued;
+        if (r.done > last)
+            last = r.done;
+
+        ASSERT(r.unit >= 0 && r.unit < MaxDisks);
+        busy[r.unit] += r.service;
+        unitRequests[r.unit]++;
+        if (r.unit >= numUnits)
+            numUnits = r.unit + 1;
+
+        for (t = 0; t < numTids && tids[t] != r.thread; t++)
+            ;
+        if (t == numTids && numTids < IOSumThreads)
+            tids[numTids++] = r.thread;	// else t is "the rest"
+        tidRequests[t]++;
+        tidWait[t] += r.queueWait + r.service;
+    }
+    Close(fd);
+    if (requests[0] + requests[1] == 0) {
+        printf("%s: no requests\n", name);
+        return;
+    }
+
+    printf("%s: %d requests, %d ticks\n", name, requests[0] + requests[1], 
+		last - first);
+    printf("%-7s %8s %8s %9s %9s %9s %9s\n", "", "requests", "sectors",
+		"avg wait", "avg seek", "avg rot", "avg xfer");
+    for (int w = 0; w < 2; w++) {
+        if (requests[w] == 0)
+            continue;
+        printf("%-7s %8d %8d %9.1f %9.1f %9.1f %9.1f\n", typeName[w], 
+		requests[w], sectors[w], wait[w] / requests[w],
+		seek[w] / requests[w], rotation[w] / requests[w],
+		(service[w] - seek[w] - rotation[w]) / requests[w]);
+    }
+    for (int i = 0; i < numUnits; i++)
+        printf("disk %d: %d requests, busy %.1f%%\n", i, unitRequests[i],
+		last > first ? 100.0 * busy[i] / (last - first) : 0.0);
+    for (int t = 0; t <= numTids; t++) {
+        if (tidRequests[t] == 0)
+            continue;
+        if (t < numTids)
+            printf("thread %d", tids[t]);
+        else
+            printf("other threads");
+        printf(": %d requests, avg latency %.1f\n", tidRequests[t], 
+		tidWait[t] / tidRequests[t]);
+    }
+    for (int w = 0; w < 2; w++) {
+        if (requests[w] == 0)
+            continue;
+        printf("Latency (%s):\n", typeName[w]);
+        PrintLatencyBuckets(latency[w]);
+    }
+}
+
+//----------------------------------------------------------------------
+// JournalTest
+// 	Metadata journal benchmark.  JTThreads threads each create, write
+//	to, and then remove, JTFiles files, all at the same time; then 
+//	the cache is synced.  Print how long that took, how many sectors 
+//	were written, and how many commits the operations were grouped 
+//	into.
+//	Run it again with "-nj" to compare.
+//
+//	Each operation should log its own few sectors, whatever the size
+//	of the free map; "-dg 32 4096 -f -jt" checks that on a 16MB disk,
+//	whose free map is 128 sectors.
+//----------------------------------------------------------------------
+
+#define JTThreads	8
+#define JTFiles		4
+
+static Semaphore *jtDone;
+
+static void
+JTWorker(int which)
+{
+    char name[16];
+    OpenFile *openFile;
+
+    for (int i = 0; i < JTFiles; i++) {
+        sprintf(name, "/jt%d.%d", which, i);
+        if (!fileSystem->Create(name, 0))
+            printf("Journal test: can't create %s\n", name);
+        else if ((openFile = fileSystem->Open(name)) != NULL) {
+            openFile->Write(name, strlen(name));	// its header is
+            delete openFile;			// written outside any
+        }					// operation
+    }
+    for (int i = 0; i < JTFiles; i++) {
+        sprintf(name, "/jt%d.%d", which, i);
+        if (!fileSystem->Remove(name))
+            printf("Journal test: unable to remove %s\n", name);
+    }
+    jtDone->V();
+}
+
+void
+JournalTest()
+{
+    int start = stats->totalTicks, writes = stats->numDiskWrites;
+    int ops = stats->numJournalOps, commits = stats->numJournalCommits;
+    int blocks = stats->numJournalBlocks;
+
+    jtDone = new Semaphore("journal test", 0);
+    for (int i = 0; i < JTThreads; i++)
+        (new Thread("journal tester"))->Fork(JTWorker, (void *) i);
+    for (int i = 0; i < JTThreads; i++)
+        jtDone->P();
+    synchDisk->Sync();
+    delete jtDone;
+
+    ops = stats->numJournalOps - ops;
+    commits = stats->numJournalCommits - commits;
+    blocks = stats->numJournalBlocks - blocks;
+    ASSERT(blocks <= ops * JournalOpSectors);
+    printf("%d creates and removes: %d ticks, %d sectors written", 
+	2 * JTThreads * JTFiles, stats->totalTicks - start, 
+	stats->numDiskWrites - writes);
+    if (commits > 0)
+        printf(", %d operations in %d commits (%.1f each)", ops, commits,
+		(double) ops / commits);
+    printf("\n");
+}
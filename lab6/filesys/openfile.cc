@@ -34,6 +34,14 @@ OpenFile::OpenFile(int sector)
     hdr = new FileHeader;
     hdr->FetchFrom(sector);
     seekPosition = 0;
+    nextRead = 0;
+    window = 0;
+    ahead = NULL;
+    aheadFirst = aheadCount = 0;
+    aheadRequest = NULL;
+    behind = NULL;
+    behindStart = behindCount = 0;
+    behindLost = 0;
 }
 
 //----------------------------------------------------------------------
@@ -43,9 +51,19 @@ OpenFile::OpenFile(int sector)
 
 OpenFile::~OpenFile()
 {
-    synchDisk->countLock[hdrSector]->Acquire();
-    synchDisk->openFileCount[hdrSector]--;
-    synchDisk->countLock[hdrSector]->Release();
+    if (behindCount > 0) {
+        ReaderWriterLock *lock = synchDisk->HeaderLock(hdrSector);
+
+        lock->writeAcquire();
+        FlushWrites();
+        lock->writeRelease();
+    }
+    if (behindLost > 0)
+        printf("Lost %d bytes written to the file at sector %d: disk full\n",
+		behindLost, hdrSector);
+    delete [] behind;
+    DropReadAhead();
+    synchDisk->HeaderClosed(hdrSector);
     delete hdr;
 }
 
@@ -69,7 +87,9 @@ OpenFile::Seek(int position)
 //	Return the number of bytes actually written or read, and as a
 //	side effect, increment the current position within the file.
 //
-//	Implemented using the more primitive ReadAt/WriteAt.
+//	Implemented using the more primitive ReadAt/WriteAt; a Read that
+//	starts where the last one ended uses ReadAhead instead, and a 
+//	small Write to the end of the file is held back (cf. openfile.h).
 //
 //	"into" -- the buffer to contain the data to be read from disk 
 //	"from" -- the buffer containing the data to be written to disk 
@@ -79,21 +99,66 @@ OpenFile::Seek(int position)
 int
 OpenFile::Read(char *into, int numBytes)
 {
+    FlushAppends();
     hdr->FetchFrom(hdrSector);
-    (synchDisk->hdrLocks[hdrSector])->readAcquire();
-    int result = ReadAt(into, numBytes, seekPosition);
-    (synchDisk->hdrLocks[hdrSector])->readRelease();
+    ReaderWriterLock *lock = synchDisk->HeaderLock(hdrSector);
+    int result;
+
+    lock->readAcquire();
+    if (readAhead && seekPosition == nextRead)
+        result = ReadAhead(into, numBytes, seekPosition);
+    else {
+        DropReadAhead();
+        window = 0;
+        result = ReadAt(into, numBytes, seekPosition);
+    }
+    lock->readRelease();
     seekPosition += result;
+    nextRead = seekPosition;
     return result;
 }
 
 int
 OpenFile::Write(char *into, int numBytes)
 {
+    ReaderWriterLock *lock = synchDisk->HeaderLock(hdrSector);
+    int result;
+    bool hold;
+
+    lock->writeAcquire();
+    if (behindLost > 0) {		// bytes we said were written weren't
+        behindLost = 0;
+        lock->writeRelease();
+        return -1;
+    }
+    OpenFile *appender = synchDisk->HeaderAppender(hdrSector);
+    if (appender != NULL && appender != this)
+        appender->FlushWrites();
     hdr->FetchFrom(hdrSector);
-    (synchDisk->hdrLocks[hdrSector])->writeAcquire();
-    int result = WriteAt(into, numBytes, seekPosition);
-    (synchDisk->hdrLocks[hdrSector])->writeRelease();
+    hold = writeBehind && numBytes > 0 && numBytes < WriteBehindSize 
+	    && seekPosition == ((behindCount > 0) ? behindStart + behindCount 
+						  : hdr->FileLength());
+    if (hold && behindCount + numBytes > WriteBehindSize)
+        FlushWrites();
+    if (hold && behindCount == 0 && !RoomBehind())
+        hold = FALSE;			// write it now, and see if it fits
+    if (hold) {
+        if (behindCount == 0) {
+            if (behind == NULL)
+                behind = new char[WriteBehindSize];
+            behindStart = seekPosition;
+            synchDisk->SetHeaderAppender(hdrSector, this);
+        }
+        bcopy(into, &behind[behindCount], numBytes);
+        behindCount += numBytes;
+        stats->numWritesHeld++;
+        result = numBytes;
+    } else {
+        FlushWrites();
+        result = WriteAt(into, numBytes, seekPosition);
+    }
+    synchDisk->HeaderWritten(hdrSector);	// read-ahead is out of date
+    lock->writeRelease();
     seekPosition += result;
     return result;
 }
@@ -130,7 +195,7 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
     hdr->setLastAccessTime();
     hdr->WriteBack(hdrSector);
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
+    int i, firstSector, lastSector, numSectors, run;
     char *buf;
 
     if ((numBytes <= 0) || (position >= fileLength))
@@ -144,11 +209,14 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
     numSectors = 1 + lastSector - firstSector;
 
-    // read in all the full and partial sectors that we need
+    // read in all the full and partial sectors that we need, a run of
+    // consecutive ones at a time
     buf = new char[numSectors * SectorSize];
-    for (i = firstSector; i <= lastSector; i++)	
-        synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
+    for (i = firstSector; i <= lastSector; i += run) {
+        run = SectorRun(i, lastSector);
+        synchDisk->ReadSectors(hdr->ByteToSector(i * SectorSize), 
+				&buf[(i - firstSector) * SectorSize], run);
+    }
 
     // copy the part we want
     bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
@@ -163,14 +231,23 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
     hdr->setLastModifyTime();
     hdr->WriteBack(hdrSector);
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
+    int i, firstSector, lastSector, numSectors, run;
     bool firstAligned, lastAligned;
     char *buf;
 
     if ((numBytes <= 0) || (position > fileLength))
 	    return 0;				// check request
     if ((position + numBytes) > fileLength) {
-        fileSystem->ExpandFile(hdr, position + numBytes);
+        bool expanded;			// the new sectors and the header
+					// are one journaled operation
+
+        synchDisk->BeginOp(IndexSectors(position + numBytes - fileLength));
+        expanded = fileSystem->ExpandFile(hdr, position + numBytes);
+        if (expanded)
+            hdr->WriteBack(hdrSector);
+        synchDisk->EndOp();
+        if (!expanded)
+            return 0;			// no room on disk
     }
     DEBUG('f', "Writing %d bytes at %d, from file of length %d.\n", 	
 			numBytes, position, fileLength);
@@ -195,14 +272,228 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
     bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
 
 // write modified sectors back
-    for (i = firstSector; i <= lastSector; i++)	{
-        synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
+    for (i = firstSector; i <= lastSector; i += run) {
+        run = SectorRun(i, lastSector);
+        synchDisk->WriteSectors(hdr->ByteToSector(i * SectorSize), 
+				&buf[(i - firstSector) * SectorSize], run);
+    }
+    delete [] buf;
+    return numBytes;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::FlushWrites
+// 	Write out the bytes held back from small appends, with a single 
+//	WriteAt.  Called with the file's lock held for writing.  If they
+//	don't all fit on disk, remember how many were lost, to report.
+//----------------------------------------------------------------------
+
+void
+OpenFile::FlushWrites()
+{
+    int count = behindCount;
+
+    if (count == 0)
+        return;
+    behindCount = 0;
+    synchDisk->SetHeaderAppender(hdrSector, NULL);
+    hdr->FetchFrom(hdrSector);
+    DEBUG('f', "Writing %d held back bytes at %d.\n", count, behindStart);
+    if (WriteAt(behind, count, behindStart) < count)
+        behindLost += count;
+    stats->numWriteFlushes++;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::RoomBehind
+// 	Return TRUE if the free map has room for a full buffer of held
+//	back bytes, index sectors included, so that holding them back
+//	does not just put off finding out that the disk is full.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::RoomBehind()
+{
+    return fileSystem->FreeSectors() >= 
+	divRoundUp(WriteBehindSize, SectorSize) + IndexSectors(WriteBehindSize);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::FlushAppends
+// 	If any OpenFile on this file, this one included, is holding back
+//	appended bytes, have it write them, so that we see them.
+//----------------------------------------------------------------------
+
+void
+OpenFile::FlushAppends()
+{
+    if (synchDisk->HeaderAppender(hdrSector) == NULL)
+        return;
+
+    ReaderWriterLock *lock = synchDisk->HeaderLock(hdrSector);
+    lock->writeAcquire();
+    OpenFile *appender = synchDisk->HeaderAppender(hdrSector);
+    if (appender != NULL)		// still
+        appender->FlushWrites();
+    lock->writeRelease();
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadAhead
+// 	Like ReadAt, but sectors in the read-ahead buffer are copied from
+//	there, waiting for them to come in from disk if need be, and only
+//	the rest are read.  If that leaves nothing read ahead beyond the
+//	sector the next Read will start in, more is asked for.
+//----------------------------------------------------------------------
+
+int
+OpenFile::ReadAhead(char *into, int numBytes, int position)
+{
+    hdr->setLastAccessTime();
+    hdr->WriteBack(hdrSector);
+    int fileLength = hdr->FileLength();
+    int i, firstSector, lastSector, numSectors, run, next;
+    char *buf;
+
+    if ((numBytes <= 0) || (position >= fileLength))
+    	return 0; 				// check request
+    if ((position + numBytes) > fileLength)		
+	    numBytes = fileLength - position;
+    DEBUG('f', "Reading %d bytes at %d, read ahead %d sectors from %d.\n",
+			numBytes, position, aheadCount, aheadFirst);
+
+    firstSector = divRoundDown(position, SectorSize);
+    lastSector = divRoundDown(position + numBytes - 1, SectorSize);
+    numSectors = 1 + lastSector - firstSector;
+
+    if (aheadCount > 0 && firstSector < aheadFirst + aheadCount
+			&& lastSector >= aheadFirst) {
+        if (aheadRequest != NULL) {
+            synchDisk->Wait(aheadRequest);
+            delete aheadRequest;
+            aheadRequest = NULL;
+        }
+        if (aheadVersion != synchDisk->HeaderVersion(hdrSector))
+            DropReadAhead();		// written since
     }
+
+    buf = new char[numSectors * SectorSize];
+    for (i = firstSector; i <= lastSector; i += run) {
+        if (i >= aheadFirst && i < aheadFirst + aheadCount) {
+            run = aheadFirst + aheadCount - i;
+            if (i + run > lastSector + 1)
+                run = lastSector + 1 - i;
+            bcopy(&ahead[(i - aheadFirst) * SectorSize], 
+			&buf[(i - firstSector) * SectorSize], run * SectorSize);
+            stats->numReadAheadHits += run;
+        } else {
+            int last = lastSector;
+
+            if (aheadCount > 0 && aheadFirst > i && aheadFirst <= lastSector)
+                last = aheadFirst - 1;
+            run = SectorRun(i, last);
+            synchDisk->ReadSectors(hdr->ByteToSector(i * SectorSize), 
+				&buf[(i - firstSector) * SectorSize], run);
+            stats->numReadAheadMisses += run;
+        }
+    }
+    bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
     delete [] buf;
+
+    next = divRoundDown(position + numBytes, SectorSize);
+    if (next + 1 >= aheadFirst + aheadCount)
+        StartReadAhead(next);
     return numBytes;
 }
 
+//----------------------------------------------------------------------
+// OpenFile::StartReadAhead
+// 	Refill the read-ahead buffer with the file's sectors from "sector"
+//	on, growing the window as we go.  "sector" itself is kept from the
+//	old buffer if it was there, since the next Read may only need the
+//	rest of it; the others are asked for in one request, which is not
+//	waited for.  Stops short of the end of the file, and of any break
+//	in the run of consecutive disk sectors.
+//----------------------------------------------------------------------
+
+void
+OpenFile::StartReadAhead(int sector)
+{
+    int lastSector = divRoundUp(hdr->FileLength(), SectorSize) - 1;
+    int keep, start, last, count;
+    char *buf;
+
+    if (aheadRequest != NULL) {
+        synchDisk->Wait(aheadRequest);
+        delete aheadRequest;
+        aheadRequest = NULL;
+    }
+    keep = (sector >= aheadFirst && sector < aheadFirst + aheadCount) ? 1 : 0;
+    start = sector + keep;
+    if (start > lastSector)
+        return;				// nothing more to read
+
+    if (window == 0)
+        window = MinReadAhead;
+    else if (window < MaxReadAhead)
+        window *= 2;
+    last = start + window - 1;
+    if (last > lastSector)
+        last = lastSector;
+    count = SectorRun(start, last);
+
+    buf = new char[(keep + count) * SectorSize];
+    if (keep)
+        bcopy(&ahead[(sector - aheadFirst) * SectorSize], buf, SectorSize);
+    delete [] ahead;
+    ahead = buf;
+    aheadFirst = sector;
+    aheadCount = keep + count;
+    aheadVersion = synchDisk->HeaderVersion(hdrSector);
+    aheadRequest = new DiskRequest(hdr->ByteToSector(start * SectorSize), 
+				&ahead[keep * SectorSize], FALSE, count);
+    synchDisk->Prefetch(aheadRequest);
+    stats->numReadAheadSectors += count;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::DropReadAhead
+// 	Empty the read-ahead buffer, first waiting for the disk if it is
+//	still reading into it.
+//----------------------------------------------------------------------
+
+void
+OpenFile::DropReadAhead()
+{
+    if (aheadRequest != NULL) {
+        synchDisk->Wait(aheadRequest);
+        delete aheadRequest;
+        aheadRequest = NULL;
+    }
+    delete [] ahead;
+    ahead = NULL;
+    aheadFirst = aheadCount = 0;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::SectorRun
+// 	Return how many of the file's sectors, from "first" up to at most
+//	"last", lie in consecutive disk sectors, so that they can be read
+//	or written with one request.
+//----------------------------------------------------------------------
+
+int
+OpenFile::SectorRun(int first, int last)
+{
+    int sector = hdr->ByteToSector(first * SectorSize);
+    int run = 1;
+
+    while (first + run <= last 
+            && hdr->ByteToSector((first + run) * SectorSize) == sector + run)
+        run++;
+    return run;
+}
+
 //----------------------------------------------------------------------
 // OpenFile::Length
 // 	Return the number of bytes in the file.
@@ -211,6 +502,7 @@ OpenFile::WriteAt(char *from, int numBytes, int position)
 int
 OpenFile::Length() 
 { 
+    FlushAppends();
     hdr->FetchFrom(hdrSector);
     return hdr->FileLength(); 
 }
@@ -60,6 +60,34 @@ class OpenFile {
 
 #else // FILESYS
 class FileHeader;
+class DiskRequest;
+
+// A file that is being read sequentially -- each Read starting where
+// the last one ended -- is read ahead: once a Read gets to the last
+// sector read so far, the sectors after it are asked for, without 
+// waiting, into a buffer that later Reads are copied out of.  The 
+// number of sectors read ahead starts at MinReadAhead, and doubles 
+// each time, up to MaxReadAhead, for as long as the file keeps being
+// read in order.  Any other Read, or a Write to the file, drops the
+// buffer.  "-nra" turns read-ahead off.
+
+#define MinReadAhead	2
+#define MaxReadAhead	32
+
+// Small Writes to the end of a file are held back: the bytes are kept
+// in memory, with no room made for them on disk, until there are 
+// WriteBehindSize of them, or the file is used some other way, or 
+// closed.  Then they are written with one WriteAt, which allocates
+// all the sectors they need at once, next to each other.  Any other 
+// OpenFile on the same file has them written first, before it reads, 
+// writes or asks the length.  "-nwb" turns this off.
+//
+// Bytes are only held back while the free map shows room for a whole
+// WriteBehindSize of them.  If the disk fills up anyway before they
+// are written, the next Write returns -1, or closing the file says
+// how many bytes were lost.
+
+#define WriteBehindSize	(MaxReadAhead * SectorSize)
 
 class OpenFile {
   public:
@@ -85,11 +113,43 @@ class OpenFile {
 					// file (this interface is simpler 
 					// than the UNIX idiom -- lseek to 
 					// end of file, tell, lseek back 
+
+    int getHdrSector() { return hdrSector; }	// identifies the file's
+					// entry in synchDisk's open headers
     
   private:
     FileHeader *hdr;			// Header for this file
     int hdrSector; 
     int seekPosition;			// Current position within the file
+
+    int SectorRun(int first, int last);	// file sectors from "first" that
+					// are consecutive on disk
+
+    int nextRead;			// where a sequential Read would start
+    int window;				// sectors to read ahead next; 0 until
+					// Reads are seen to be sequential
+    char *ahead;			// the read-ahead buffer, holding file
+    int aheadFirst, aheadCount;		// sectors aheadFirst on
+    int aheadVersion;			// of the file, when it was read
+    DiskRequest *aheadRequest;		// the read, if it may not be done
+
+    int ReadAhead(char *into, int numBytes, int position);
+					// ReadAt, out of the read-ahead 
+					// buffer where it can
+    void StartReadAhead(int sector);	// refill the buffer, from "sector"
+    void DropReadAhead();
+
+    char *behind;			// bytes appended but not written,
+    int behindStart, behindCount;	// which go at behindStart
+    int behindLost;			// bytes held back that could not be
+					// written, not yet reported
+
+    void FlushWrites();			// write them, with the file's
+					// lock held for writing
+    bool RoomBehind();			// room on disk to hold more back?
+    void FlushAppends();		// have whichever OpenFile on this
+					// file is holding bytes back write
+					// them
 };
 
 #endif // FILESYS
@@ -5,10 +5,17 @@
 //	the disk providing a synchronous interface (requests wait until
 //	the request completes).
 //
-//	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	Each request has a semaphore, to synchronize the interrupt 
+//	handler with the thread that is waiting for it.  Because each
+//	physical disk can only handle one operation at a time, the others 
+//	wait in its queue, and the interrupt handler starts the next one
+//	as it finishes each; so the queues are protected by turning
+//	interrupts off, rather than by a lock.
+//
+//	Sectors are cached (cf. synchdisk.h).  A cache entry that is being
+//	read or written is marked busy, and left alone by everybody else
+//	until the I/O is done, so that the cache lock need not be held 
+//	across it.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -16,6 +23,7 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "bitmap.h"
 #include "system.h"
 
 //----------------------------------------------------------------------
@@ -27,9 +35,15 @@
 static void
 DiskRequestDone (int arg)
 {
-    SynchDisk* disk = (SynchDisk *)arg;
+    DiskUnit* unit = (DiskUnit *)arg;
+
+    unit->volume->RequestDone(unit);
+}
 
-    disk->RequestDone();
+static void
+DiskFlusher (int arg)
+{
+    ((SynchDisk *)arg)->Flusher();
 }
 
 //----------------------------------------------------------------------
@@ -39,18 +53,70 @@ DiskRequestDone (int arg)
 //
 //	"name" -- UNIX file name to be used as storage for the disk data
 //	   (usually, "DISK")
+//	"cacheSectors" -- how many sectors to cache; 0 for none
+//	"disks" -- how many disks to stripe the sectors across
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk(char* name)
+SynchDisk::SynchDisk(char* name, int cacheSectors, int disks)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
-    disk = new Disk(name, DiskRequestDone, (int) this);
+    int tracks = NumTracks / disks;	// each, if the disks are new
+    char *unitName = new char[strlen(name) + 8];
+
+    ASSERT((disks >= 1) && (disks <= MaxDisks) && (tracks > 0));
+    numDisks = disks;
+    traceFile = -1;
+    units = new DiskUnit[numDisks];
+    for (int i = 0; i < numDisks; i++) {
+        DiskUnit *u = &units[i];
 
-    for (int i = 0; i < NumSectors; i++) {
-        hdrLocks[i] = NULL;
-        countLock[i] = new Lock("OpenFile count lock");
+        if (numDisks == 1)
+            strcpy(unitName, name);
+        else
+            sprintf(unitName, "%s.%d", name, i);
+        u->volume = this;
+        u->queue = u->active = NULL;
+        u->scanUp = TRUE;
+        u->disk = new Disk(unitName, DiskRequestDone, (int) u, tracks);
+        ASSERT(u->disk->getNumTracks() == units[0].disk->getNumTracks());
     }
+    delete [] unitName;
+    diskNumTracks = numDisks * units[0].disk->getNumTracks();
+    ASSERT((numDisks == 1) || (NumSectors % (numDisks * StripeSectors) == 0));
+    diskPolicy = CLOOK;
+
+    for (int i = 0; i < OpenBuckets; i++)
+        openHeaders[i] = NULL;
+    openLock = new Lock("open file headers lock");
+
+    journalOn = committing = FALSE;
+    outstanding = reserved = installs = txCount = 0;
+    txSectors = NULL;
+    txData = NULL;
+
+    numEntries = cacheSectors;
+    numDirty = 0;
+    newest = oldest = NULL;
+    for (int i = 0; i < CacheBuckets; i++)
+        buckets[i] = NULL;
+    entries = NULL;
+    if (numEntries == 0)
+        return;
+    entries = new CacheEntry[numEntries];
+    for (int i = 0; i < numEntries; i++) {
+        entries[i].valid = entries[i].dirty = entries[i].busy = FALSE;
+        entries[i].hashNext = NULL;
+        entries[i].newer = NULL;
+        entries[i].older = newest;
+        if (newest != NULL)
+            newest->newer = &entries[i];
+        else
+            oldest = &entries[i];
+        newest = &entries[i];
+    }
+    cacheLock = new Lock("disk cache lock");
+    ioDone = new Condition("disk cache I/O done");
+    flushNeeded = new Condition("disk cache flush needed");
+    (new Thread("disk flusher"))->Fork(DiskFlusher, (void *) this);
 }
 
 //----------------------------------------------------------------------
@@ -61,11 +127,68 @@ SynchDisk::SynchDisk(char* name)
 
 SynchDisk::~SynchDisk()
 {
-    delete disk;
-    delete lock;
-    delete semaphore;
-    for (int i = 0; i < NumSectors; i++)
-        delete countLock[i];
+    int where;
+
+    for (int i = 0; i < numEntries; i++)	// too late for interrupts
+        if (entries[i].valid && entries[i].dirty)
+            Locate(entries[i].sector, &where)->disk->WriteNow(where, 
+							entries[i].data);
+    if (journalOn) {
+        JournalSuper super;
+
+        if (!committing) {		// every transaction in the log is
+					// on disk now, so it need not be
+					// replayed
+            bzero((char *) &super, sizeof(super));
+            super.magic = JournalMagic;
+            super.seq = journalSeq;
+            super.sectors = journalSectors;
+            Locate(journalStart, &where)->disk->WriteNow(where, 
+							(char *) &super);
+        }
+        delete [] txSectors;
+        delete [] txData;
+        delete journalLock;
+        delete journalIdle;
+    }
+    if (numEntries > 0) {
+        delete [] entries;
+        delete cacheLock;
+        delete ioDone;
+        delete flushNeeded;
+    }
+    for (int i = 0; i < numDisks; i++)
+        delete units[i].disk;
+    delete [] units;
+    for (int i = 0; i < OpenBuckets; i++)
+        while (openHeaders[i] != NULL) {
+            OpenHeader *h = openHeaders[i];
+
+            openHeaders[i] = h->next;
+            delete h->lock;
+            delete h;
+        }
+    delete openLock;
+    if (traceFile >= 0)
+        Close(traceFile);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::StartTrace
+// 	Write a record of each request the disks finish from now on to 
+//	the UNIX file "traceName", after the header (cf. synchdisk.h).
+//----------------------------------------------------------------------
+
+void
+SynchDisk::StartTrace(char *traceName)
+{
+    int header[2];
+
+    ASSERT(traceFile < 0);
+    traceFile = OpenForWrite(traceName);
+    header[0] = IOTraceMagic;
+    header[1] = sizeof(IOTraceRecord);
+    WriteFile(traceFile, (char *) header, sizeof(header));
 }
 
 //----------------------------------------------------------------------
@@ -80,16 +203,13 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    ReadSectors(sectorNumber, data, 1);
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::WriteSector
 // 	Write the contents of a buffer into a disk sector.  Return only
-//	after the data has been written.
+//	after the data has been written (to the cache, if there is one).
 //
 //	"sectorNumber" -- the disk sector to be written
 //	"data" -- the new contents of the disk sector
@@ -98,78 +218,1192 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    WriteSectors(sectorNumber, data, 1);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadSectors
+// 	Read "count" consecutive sectors into a buffer.  With the 
+//	journal, any of them in the current transaction are copied from
+//	there; if the transaction was installed in the meantime, so that
+//	what was read may be out of date, they are read again.
+//
+//	"sectorNumber" -- the first disk sector to read
+//	"data" -- the buffer to hold the contents of the disk sectors
+//	"count" -- how many sectors
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadSectors(int sectorNumber, char* data, int count)
+{
+    int since;
+
+    do {
+        since = installs;
+        CacheRead(sectorNumber, data, count);
+    } while (journalOn && !Overlay(sectorNumber, data, count, since));
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::CacheRead
+// 	Read "count" consecutive sectors into a buffer.  The ones that
+//	are cached are copied from the cache; each run of ones that 
+//	aren't is read with a single request, and then cached.
+//
+//	The entries for a run are taken first, and kept busy until it
+//	has been read into them, as GetEntry does for a single sector;
+//	so nobody can write one of the sectors meanwhile, only to have
+//	it put back as it was on disk.  Only the first is waited for:
+//	the run stops short at a sector somebody else has cached by 
+//	then, or when there is no clean entry free to take, so that we 
+//	never wait holding busy entries.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::CacheRead(int sectorNumber, char* data, int count)
+{
+    CacheEntry *e, **taken = NULL;
+    bool fresh;
+    int i, j, run;
+
+    if (numEntries == 0) {
+        DiskIO(sectorNumber, data, FALSE, count);
+        return;
+    }
+    cacheLock->Acquire();
+    for (i = 0; i < count; i += run) {
+        run = 1;
+        if (Lookup(sectorNumber + i) == NULL)
+            while (i + run < count && run < MaxTransfer
+                    && Lookup(sectorNumber + i + run) == NULL)
+                run++;
+        if (run == 1) {
+            e = GetEntry(sectorNumber + i, TRUE);
+            bcopy(e->data, &data[i * SectorSize], SectorSize);
+            continue;
+        }
+
+        if (taken == NULL)
+            taken = new CacheEntry *[MaxTransfer];
+        e = GetEntry(sectorNumber + i, FALSE, &fresh);
+        if (!fresh) {			// somebody beat us to it
+            bcopy(e->data, &data[i * SectorSize], SectorSize);
+            run = 1;
+            continue;
+        }
+        e->busy = TRUE;			// not read in yet
+        taken[0] = e;
+        for (j = 1; j < run; j++) {
+            if (Lookup(sectorNumber + i + j) != NULL)
+                break;
+            for (e = oldest; e != NULL && (e->busy || e->dirty); 
+							e = e->newer)
+                ;
+            if (e == NULL)
+                break;
+            stats->numCacheMisses++;
+            Replace(e, sectorNumber + i + j);
+            e->busy = TRUE;
+            taken[j] = e;
+        }
+        run = j;
+
+        cacheLock->Release();
+        DiskIO(sectorNumber + i, &data[i * SectorSize], FALSE, run);
+        cacheLock->Acquire();
+        for (j = 0; j < run; j++) {
+            bcopy(&data[(i + j) * SectorSize], taken[j]->data, SectorSize);
+            taken[j]->busy = FALSE;
+        }
+        ioDone->Broadcast(cacheLock);
+    }
+    cacheLock->Release();
+    delete [] taken;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteSectors
+// 	Write "count" consecutive sectors from a buffer: to the current
+//	transaction, if this thread is in an operation or the transaction
+//	already has them, or else to the cache.
+//
+//	"sectorNumber" -- the first disk sector to write
+//	"data" -- the new contents of the disk sectors
+//	"count" -- how many sectors
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteSectors(int sectorNumber, char* data, int count)
+{
+    bool held;
+
+    if (!journalOn) {
+        CacheWrite(sectorNumber, data, count);
+        return;
+    }
+    for (int i = 0, n; i < count; i += n) {
+        n = LogWrite(sectorNumber + i, &data[i * SectorSize], count - i, 
+			&held);
+        if (!held)
+            CacheWrite(sectorNumber + i, &data[i * SectorSize], n);
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::CacheWrite
+// 	Write "count" consecutive sectors from a buffer.  With the cache,
+//	they only go as far as the cache for now.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::CacheWrite(int sectorNumber, char* data, int count)
+{
+    if (numEntries == 0) {
+        DiskIO(sectorNumber, data, TRUE, count);
+        return;
+    }
+    cacheLock->Acquire();
+    for (int i = 0; i < count; i++) {
+        CacheEntry *e = GetEntry(sectorNumber + i, FALSE);	// all of it
+								// is new
+        bcopy(&data[i * SectorSize], e->data, SectorSize);
+        if (!e->dirty) {
+            e->dirty = TRUE;
+            if (++numDirty >= numEntries / 2)
+                flushNeeded->Signal(cacheLock);
+        }
+    }
+    cacheLock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::DiskIO
+// 	Read or write sectors on the disk itself, returning once it is
+//	done.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::DiskIO(int sectorNumber, char* data, bool writing, int count)
+{
+    DiskRequest request(sectorNumber, data, writing, count);
+
+    Submit(&request);
+    Wait(&request);
+}
+
+//----------------------------------------------------------------------
+// DiskRequest::DiskRequest
+// 	Set up a request to read or write a sector, to be submitted to 
+//	a SynchDisk.
+//----------------------------------------------------------------------
+
+DiskRequest::DiskRequest(int sectorNumber, char* buffer, bool write, int n)
+{
+    sector = sectorNumber;
+    count = n;
+    data = buffer;
+    writing = write;
+    done = new Semaphore("disk request", 0);
+    next = NULL;
+    unit = where = 0;
+    parts = nextPart = NULL;
+    thread = submitted = started = seek = rotation = 0;
+}
+
+DiskRequest::~DiskRequest()
+{
+    delete done;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Submit
+// 	Queue a request for the disks, starting it if its disk is idle, 
+//	and return without waiting for it.  A request that covers more
+//	than one stripe is split into a request for each.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Submit(DiskRequest *request)
+{
+    int first = request->sector / StripeSectors;
+    int last = (request->sector + request->count - 1) / StripeSectors;
+
+    ASSERT((request->sector >= 0) && (request->count > 0)
+		&& (request->sector + request->count <= NumSectors));
+    request->parts = NULL;
+    if (numDisks == 1 || first == last) {
+        Queue(request);
+        return;
+    }
+
+    DiskRequest **tail = &request->parts;
+    for (int i = 0, n; i < request->count; i += n) {
+        int sector = request->sector + i;
+
+        n = StripeSectors - sector % StripeSectors;
+        if (n > request->count - i)
+            n = request->count - i;
+        *tail = new DiskRequest(sector, request->data + i * SectorSize, 
+				request->writing, n);
+        tail = &(*tail)->nextPart;
+    }
+    for (DiskRequest *part = request->parts; part != NULL; 
+					part = part->nextPart)
+        Queue(part);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Locate
+// 	Return the disk that "sectorNumber" of the volume is on, and set
+//	"where" to the sector on that disk.
+//----------------------------------------------------------------------
+
+DiskUnit *
+SynchDisk::Locate(int sectorNumber, int *where)
+{
+    int stripe = sectorNumber / StripeSectors;
+
+    *where = (stripe / numDisks) * StripeSectors 
+			+ sectorNumber % StripeSectors;
+    return &units[stripe % numDisks];
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Queue
+// 	Add a request, which is all on one disk, to that disk's queue,
+//	starting it if the disk is idle.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Queue(DiskRequest *request)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    DiskUnit *u = Locate(request->sector, &request->where);
+    DiskRequest **last = &u->queue;
+
+    request->unit = u - units;
+    request->thread = currentThread->getTid();
+    request->submitted = stats->totalTicks;
+    while (*last != NULL)
+        last = &(*last)->next;
+    request->next = NULL;
+    *last = request;
+    if (u->active == NULL)
+        StartNext(u);
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Wait
+// 	Return once a submitted request is done: all of it, if it was 
+//	split up.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Wait(DiskRequest *request)
+{
+    if (request->parts == NULL) {
+        request->done->P();
+        return;
+    }
+    while (request->parts != NULL) {
+        DiskRequest *part = request->parts;
+
+        part->done->P();
+        request->parts = part->nextPart;
+        delete part;
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Prefetch
+// 	Submit a request to read sectors, for somebody who will Wait for
+//	it later, having first written out any of them that are dirty in
+//	the cache, so that what is read is up to date.  The sectors read
+//	are not put in the cache.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Prefetch(DiskRequest *request)
+{
+    ASSERT(!request->writing);
+    if (numEntries > 0) {
+        cacheLock->Acquire();
+        for (int i = 0; i < request->count; i++) {
+            CacheEntry *e;
+
+            while ((e = Lookup(request->sector + i)) != NULL && e->dirty) {
+                if (e->busy)		// already being written out
+                    ioDone->Wait(cacheLock);
+                else
+                    WriteBack(e);
+            }
+        }
+        cacheLock->Release();
+    }
+    Submit(request);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::StartNext
+// 	A disk is idle: take the request the policy says is next off 
+//	its queue, and give it to the disk.  Called with interrupts off.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::StartNext(DiskUnit *u)
+{
+    DiskRequest **pick = NULL, **p;
+    int head = u->disk->getLastSector() / SectorsPerTrack;
+
+    ASSERT(u->active == NULL);
+    if (u->queue == NULL)
+        return;
+
+    switch (diskPolicy) {
+      case FCFS:
+        pick = &u->queue;
+        break;
+      case SSTF:
+        for (p = &u->queue; *p != NULL; p = &(*p)->next)
+            if (pick == NULL || abs((*p)->where / SectorsPerTrack - head) 
+                    < abs((*pick)->where / SectorsPerTrack - head))
+                pick = p;
+        break;
+      case SCAN:
+      case CLOOK:
+        // nearest request ahead of the head, in sector order
+        for (p = &u->queue; *p != NULL; p = &(*p)->next) {
+            int track = (*p)->where / SectorsPerTrack;
+
+            if ((u->scanUp ? track < head : track > head))
+                continue;
+            if (pick == NULL || (u->scanUp ? (*p)->where < (*pick)->where
+                                        : (*p)->where > (*pick)->where))
+                pick = p;
+        }
+        if (pick != NULL)
+            break;
+        if (diskPolicy == SCAN)		// nothing ahead: turn around
+            u->scanUp = !u->scanUp;
+        for (p = &u->queue; *p != NULL; p = &(*p)->next)	// CLOOK: the
+            if (pick == NULL || (u->scanUp ? (*p)->where < (*pick)->where
+                                        : (*p)->where > (*pick)->where))
+                pick = p;			// lowest; SCAN: the nearest
+        break;
+    }
+
+    DiskRequest *active = *pick;
+
+    u->active = active;
+    *pick = active->next;
+    active->next = NULL;
+    if (active->writing)
+        u->disk->WriteRequest(active->where, active->data, active->count);
+    else
+        u->disk->ReadRequest(active->where, active->data, active->count);
+    active->started = stats->totalTicks;
+    active->seek = u->disk->getSeekTicks();
+    active->rotation = u->disk->getRotationTicks();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::GetEntry
+// 	Return the cache entry for a sector, most recently used now, and
+//	not busy.  If the sector isn't cached, replace the least recently
+//	used entry that isn't busy, writing it out first if it is dirty,
+//	and then read the sector in if "fill" is set.  "fresh", if given,
+//	is set to whether the sector had to be given a new entry.
+//
+//	Called, and returns, with cacheLock held; it is let go of while
+//	waiting for the disk, so everything is looked at afresh after.
+//----------------------------------------------------------------------
+
+CacheEntry *
+SynchDisk::GetEntry(int sectorNumber, bool fill, bool *fresh)
+{
+    CacheEntry *e;
+
+    for (;;) {
+        e = Lookup(sectorNumber);
+        if (e != NULL) {
+            if (e->busy) {		// somebody is reading it in
+                ioDone->Wait(cacheLock);
+                continue;
+            }
+            stats->numCacheHits++;
+            Touch(e);
+            if (fresh != NULL)
+                *fresh = FALSE;
+            return e;
+        }
+
+        for (e = oldest; e != NULL && e->busy; e = e->newer)
+            ;
+        if (e == NULL) {		// everything is busy
+            ioDone->Wait(cacheLock);
+            continue;
+        }
+        if (e->dirty) {
+            WriteBack(e);
+            continue;
+        }
+
+        stats->numCacheMisses++;
+        if (fresh != NULL)
+            *fresh = TRUE;
+        Replace(e, sectorNumber);
+        if (fill) {
+            e->busy = TRUE;
+            cacheLock->Release();
+            DiskIO(sectorNumber, e->data, FALSE);
+            cacheLock->Acquire();
+            e->busy = FALSE;
+            ioDone->Broadcast(cacheLock);
+        }
+        return e;
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Replace
+// 	Give a clean entry that isn't busy to "sectorNumber", and make it
+//	the most recently used.  Its data is whatever it was.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Replace(CacheEntry *e, int sectorNumber)
+{
+    ASSERT(!e->busy && !e->dirty);
+    if (e->valid)
+        Unhash(e);
+    e->sector = sectorNumber;
+    e->valid = TRUE;
+    e->hashNext = buckets[sectorNumber % CacheBuckets];
+    buckets[sectorNumber % CacheBuckets] = e;
+    Touch(e);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Lookup
+// 	Return the cache entry holding a sector, or NULL if it isn't 
+//	cached.  The entry may be busy.
+//----------------------------------------------------------------------
+
+CacheEntry *
+SynchDisk::Lookup(int sectorNumber)
+{
+    CacheEntry *e;
+
+    for (e = buckets[sectorNumber % CacheBuckets]; e != NULL; e = e->hashNext)
+        if (e->sector == sectorNumber)
+            return e;
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Touch
+// 	Move a cache entry to the most recently used end of the LRU list.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Touch(CacheEntry *e)
+{
+    if (e == newest)
+        return;
+    if (e->older != NULL)			// take it out
+        e->older->newer = e->newer;
+    else
+        oldest = e->newer;
+    e->newer->older = e->older;
+    e->older = newest;				// and put it at the end
+    e->newer = NULL;
+    newest->newer = e;
+    newest = e;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Unhash
+// 	Take a cache entry out of its hash chain.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Unhash(CacheEntry *e)
+{
+    CacheEntry **p = &buckets[e->sector % CacheBuckets];
+
+    while (*p != e)
+        p = &(*p)->hashNext;
+    *p = e->hashNext;
+    e->hashNext = NULL;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteBack
+// 	Write a dirty cache entry out to disk, together with the dirty
+//	entries for the sectors just after it, up to MaxTransfer in all,
+//	in a single request.  Called with cacheLock held, which is let go
+//	of during the write.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteBack(CacheEntry *e)
+{
+    CacheEntry **run = new CacheEntry *[MaxTransfer];
+    int n = 0;
+
+    ASSERT(e->valid && e->dirty && !e->busy);
+    do {
+        e->busy = TRUE;
+        run[n++] = e;
+        e = Lookup(e->sector + 1);
+    } while (n < MaxTransfer && e != NULL && e->dirty && !e->busy);
+
+    char *buf = new char[n * SectorSize];
+    for (int i = 0; i < n; i++)
+        bcopy(run[i]->data, &buf[i * SectorSize], SectorSize);
+    cacheLock->Release();
+    DiskIO(run[0]->sector, buf, TRUE, n);
+    cacheLock->Acquire();
+    for (int i = 0; i < n; i++) {
+        run[i]->busy = FALSE;
+        run[i]->dirty = FALSE;
+    }
+    numDirty -= n;
+    delete [] buf;
+    delete [] run;
+    ioDone->Broadcast(cacheLock);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Sync
+// 	Write every dirty sector in the cache out to disk, in sector
+//	order and in runs, returning once they are all written.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Sync()
+{
+    if (numEntries == 0)
+        return;
+    cacheLock->Acquire();
+    for (;;) {
+        CacheEntry *next = NULL;
+        bool writing = FALSE;		// somebody else is writing one
+
+        for (int i = 0; i < numEntries; i++) {
+            CacheEntry *e = &entries[i];
+
+            if (!e->valid || !e->dirty)
+                continue;
+            if (e->busy)
+                writing = TRUE;
+            else if (next == NULL || e->sector < next->sector)
+                next = e;
+        }
+        if (next != NULL)
+            WriteBack(next);
+        else if (writing)
+            ioDone->Wait(cacheLock);
+        else
+            break;
+    }
+    cacheLock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Flusher
+// 	The flusher thread.  Sleep until half the cache is dirty, and 
+//	then write it all out, so that writers seldom have to wait for a
+//	dirty sector to be written before they can replace it.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Flusher()
+{
+    for (;;) {
+        cacheLock->Acquire();
+        while (numDirty < numEntries / 2)
+            flushNeeded->Wait(cacheLock);
+        cacheLock->Release();
+        Sync();
+    }
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::RequestDone
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// 	Disk interrupt handler, for disk "u".  Start its next request, 
+//	and wake up the thread waiting for the one that finished.  Its
+//	times go into the statistics, and the trace if there is one.
 //----------------------------------------------------------------------
 
 void
-SynchDisk::RequestDone()
+SynchDisk::RequestDone(DiskUnit *u)
 { 
-    semaphore->V();
+    DiskRequest *done = u->active;
+    int service = stats->totalTicks - done->started;
+
+    stats->RecordDiskIO(done->writing, done->started - done->submitted, 
+				service);
+    if (traceFile >= 0) {
+        IOTraceRecord r;
+
+        r.done = stats->totalTicks;
+        r.sector = done->sector;
+        r.count = done->count;
+        r.writing = done->writing;
+        r.unit = done->unit;
+        r.thread = done->thread;
+        r.queueWait = done->started - done->submitted;
+        r.seek = done->seek;
+        r.rotation = done->rotation;
+        r.service = service;
+        WriteFile(traceFile, (char *) &r, sizeof(r));
+    }
+    u->active = NULL;
+    StartNext(u);			// keep the disk busy
+    done->done->V();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::FindHeader
+// 	Return where the open file header at "sector" is in its hash 
+//	chain: a pointer to the pointer to it, or to the NULL at the end
+//	of the chain if it isn't open.  Called with openLock held.
+//----------------------------------------------------------------------
+
+OpenHeader **
+SynchDisk::FindHeader(int sector)
+{
+    OpenHeader **p = &openHeaders[sector % OpenBuckets];
+
+    while (*p != NULL && (*p)->sector != sector)
+        p = &(*p)->next;
+    return p;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::HeaderOpened
+// 	Note that an OpenFile is being made for the file header at 
+//	"sector", making it an entry with a reader/writer lock if it is
+//	the first.  Return FALSE, and note nothing, if the file is being
+//	removed.
+//----------------------------------------------------------------------
+
+bool
+SynchDisk::HeaderOpened(int sector)
+{
+    bool ok = TRUE;
+
+    openLock->Acquire();
+    OpenHeader **p = FindHeader(sector);
+    if (*p == NULL) {
+        OpenHeader *h = new OpenHeader;
+
+        h->sector = sector;
+        h->count = 0;
+        h->version = 0;
+        h->appender = NULL;
+        h->lock = new ReaderWriterLock("file ReaderWriterLock");
+        h->next = NULL;
+        *p = h;
+    }
+    if ((*p)->count == -1)
+        ok = FALSE;
+    else
+        (*p)->count++;
+    openLock->Release();
+    return ok;
 }
 
+//----------------------------------------------------------------------
+// SynchDisk::HeaderClosed
+// 	Note that an OpenFile on the file header at "sector" has been 
+//	deleted, dropping the entry once the last one has.  OpenFiles the
+//	file system makes for itself (on directories, say) never had an
+//	entry, and are ignored.
+//----------------------------------------------------------------------
 
+void
+SynchDisk::HeaderClosed(int sector)
+{
+    openLock->Acquire();
+    OpenHeader **p = FindHeader(sector);
+    OpenHeader *h = *p;
+    if (h != NULL && h->count > 0 && --h->count == 0) {
+        *p = h->next;
+        delete h->lock;
+        delete h;
+    }
+    openLock->Release();
+}
 
+//----------------------------------------------------------------------
+// SynchDisk::HeaderRemoving
+// 	Get ready to remove the file whose header is at "sector".  Return
+//	FALSE if it is open; otherwise, keep it from being opened until 
+//	HeaderRemoved is called.
+//----------------------------------------------------------------------
 
-PipeFile::PipeFile(char *_path) {
-    path = new char[strlen(_path) + 1];
-    strcpy(path, _path);
-    readFile = NULL;
-    pipeLength = 0;
-    lock = new Lock("");
+bool
+SynchDisk::HeaderRemoving(int sector)
+{
+    bool ok = FALSE;
+
+    openLock->Acquire();
+    OpenHeader **p = FindHeader(sector);
+    if (*p == NULL) {
+        OpenHeader *h = new OpenHeader;
+
+        h->sector = sector;
+        h->count = -1;
+        h->version = 0;
+        h->appender = NULL;
+        h->lock = NULL;
+        h->next = NULL;
+        *p = h;
+        ok = TRUE;
+    }
+    openLock->Release();
+    return ok;
 }
 
-PipeFile::~PipeFile() {
-    if (readFile != NULL) {
-        fileSystem->Remove(path);
-        delete readFile;
+//----------------------------------------------------------------------
+// SynchDisk::HeaderRemoved
+// 	The file whose header was at "sector" is gone; the sector may be
+//	used for another one.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::HeaderRemoved(int sector)
+{
+    openLock->Acquire();
+    OpenHeader **p = FindHeader(sector);
+    OpenHeader *h = *p;
+    if (h != NULL) {
+        ASSERT(h->count == -1);
+        *p = h->next;
+        delete h;
     }
-    delete lock;
-    delete [] path;
+    openLock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::HeaderLock
+// 	Return the reader/writer lock for the open file whose header is 
+//	at "sector".
+//----------------------------------------------------------------------
+
+ReaderWriterLock *
+SynchDisk::HeaderLock(int sector)
+{
+    openLock->Acquire();
+    OpenHeader *h = *FindHeader(sector);
+    openLock->Release();
+
+    ASSERT(h != NULL && h->count > 0);
+    return h->lock;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::HeaderVersion, HeaderWritten
+// 	Return how many times the open file whose header is at "sector"
+//	has been written to, and count one more.  Anything read from the
+//	file while it had an older version may be out of date.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::HeaderVersion(int sector)
+{
+    openLock->Acquire();
+    OpenHeader *h = *FindHeader(sector);
+    int version = (h != NULL) ? h->version : 0;
+    openLock->Release();
+    return version;
+}
+
+void
+SynchDisk::HeaderWritten(int sector)
+{
+    openLock->Acquire();
+    OpenHeader *h = *FindHeader(sector);
+    if (h != NULL)
+        h->version++;
+    openLock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::HeaderAppender, SetHeaderAppender
+// 	Return, and set, which OpenFile (if any) on the file whose header
+//	is at "sector" is holding back bytes appended to the file.  The
+//	others must have it write them out before they use the file.
+//----------------------------------------------------------------------
+
+OpenFile *
+SynchDisk::HeaderAppender(int sector)
+{
+    openLock->Acquire();
+    OpenHeader *h = *FindHeader(sector);
+    OpenFile *file = (h != NULL) ? h->appender : NULL;
+    openLock->Release();
+    return file;
 }
 
+void
+SynchDisk::SetHeaderAppender(int sector, OpenFile *file)
+{
+    openLock->Acquire();
+    OpenHeader *h = *FindHeader(sector);
+    ASSERT(h != NULL && h->count > 0);
+    h->appender = file;
+    openLock->Release();
+}
+
+//----------------------------------------------------------------------
+// JournalChecksum
+// 	FNV-1a hash of "bytes" bytes, continuing from "hash".
+//----------------------------------------------------------------------
+
+#define JournalHashBasis	2166136261u
+
+static unsigned
+JournalChecksum(char *data, int bytes, unsigned hash)
+{
+    for (int i = 0; i < bytes; i++)
+        hash = (hash ^ (data[i] & 0xff)) * 16777619u;
+    return hash;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::StartJournal
+// 	Begin journaling the file system's metadata, in the log whose
+//	JournalSuper is at "sector".  With "format", the log is new, and
+//	JournalSectors long; otherwise the transactions in it are replayed
+//	first, and it is as long as its JournalSuper says.  Return FALSE,
+//	and leave the disk alone, if there is no log there (the disk was 
+//	formatted before there were logs).
+//
+//	With "-nj", the log is replayed, but not used from then on.
+//----------------------------------------------------------------------
+
 bool
-PipeFile::open() {
-    fileSystem->Create(path, 0);
-    readFile = fileSystem->Open(path);
+SynchDisk::StartJournal(int sector, bool format)
+{
+    ASSERT(!journalOn);
+    journalStart = sector;
+    if (format) {
+        journalSeq = 1;
+        journalSectors = JournalSectors;
+    } else {
+        JournalSuper super;
+
+        DiskIO(journalStart, (char *) &super, FALSE);
+        if (super.magic != JournalMagic || super.sectors < JournalMinSectors
+		|| journalStart + super.sectors > NumSectors)
+            return FALSE;
+        journalSeq = super.seq;
+        journalSectors = super.sectors;
+        for (int at = 1, n; (n = ReadTransaction(at, FALSE)) > 0; at += n) {
+            (void) ReadTransaction(at, TRUE);
+            DEBUG('f', "Replayed journal transaction %d.\n", journalSeq);
+            journalSeq++;
+            stats->numJournalReplayed++;
+        }
+        Sync();
+    }
+    WriteSuper();
+    journalHead = 1;
+    if (!journaling)
+        return TRUE;
+
+    maxTx = (journalSectors - 1) * JournalTags / (JournalTags + 1);
+    bitmapSectors = JournalMapSectors;
+    ASSERT(JournalOpSectors + bitmapSectors <= maxTx);
+    txSectors = new int[maxTx];
+    txData = new char[maxTx * SectorSize];
+    for (int i = 0; i < JournalMaxOps; i++)
+        opThread[i] = NULL;
+    journalLock = new Lock("journal lock");
+    journalIdle = new Condition("journal idle");
+    journalOn = TRUE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::BeginOp
+// 	Start an operation on the file system's metadata: until EndOp,
+//	the sectors this thread writes go to the current transaction.  
+//	First wait until the transaction has room for as many sectors as
+//	the operation might write: JournalOpSectors, the free map, and 
+//	"extra" more.  An operation begun inside another is part of it.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::BeginOp(int extra)
+{
+    int reserve = JournalOpSectors + bitmapSectors + extra;
+    int i;
+
+    if (!journalOn)
+        return;
+    journalLock->Acquire();
+    if ((i = FindOp(currentThread)) >= 0) {
+        opDepth[i]++;
+        journalLock->Release();
+        return;
+    }
+    ASSERT(reserve <= maxTx);
+    while (committing || outstanding == JournalMaxOps 
+			|| txCount + reserved + reserve > maxTx)
+        journalIdle->Wait(journalLock);
+    i = FindOp(NULL);
+    opThread[i] = currentThread;
+    opDepth[i] = 1;
+    opReserve[i] = reserve;
+    outstanding++;
+    reserved += reserve;
+    journalLock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::EndOp
+// 	End an operation.  If it is the last one in the transaction, 
+//	commit the transaction; otherwise leave that to the last one,
+//	so that they all share one log write.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::EndOp()
+{
+    int i;
+
+    if (!journalOn)
+        return;
+    journalLock->Acquire();
+    i = FindOp(currentThread);
+    ASSERT(i >= 0);
+    if (--opDepth[i] == 0) {
+        opThread[i] = NULL;
+        outstanding--;
+        reserved -= opReserve[i];
+        stats->numJournalOps++;
+        if (outstanding == 0 && txCount > 0)
+            Commit();
+        journalIdle->Broadcast(journalLock);
+    }
+    journalLock->Release();
+}
+
+int
+SynchDisk::FindOp(Thread *t)
+{
+    for (int i = 0; i < JournalMaxOps; i++)
+        if (opThread[i] == t)
+            return i;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::LogWrite
+// 	If this thread is in an operation, put the sectors in the 
+//	current transaction, and set "held".  Otherwise, sectors that
+//	are in the transaction are changed there, and wait for it to be
+//	committed like the rest: in the cache, they could be written home
+//	before the commit, with the operations' changes in them.  The 
+//	others go to the cache as usual.
+//
+//	Return how many of the sectors, from the first, were dealt with 
+//	the same way; "held" is TRUE if they went to the transaction.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::LogWrite(int sectorNumber, char* data, int count, bool *held)
+{
+    int i;
+
+    journalLock->Acquire();
+    int op = FindOp(currentThread);
+
+    if (op < 0)
+        while (committing)		// the transaction can't be changed
+            journalIdle->Wait(journalLock);
+    for (i = 0; i < count; i++) {
+        int j = 0;
+
+        while (j < txCount && txSectors[j] != sectorNumber + i)
+            j++;
+        if (i == 0)
+            *held = (op >= 0 || j < txCount);
+        if (op < 0 && (j < txCount) != *held)
+            break;			// the rest are dealt with next
+        if (j == txCount) {
+            if (op < 0)
+                continue;
+            ASSERT(txCount < maxTx);	// else the log is too small
+            txSectors[txCount++] = sectorNumber + i;
+            if (opReserve[op] > 0) {
+                opReserve[op]--;
+                reserved--;
+            }
+        }
+        bcopy(&data[i * SectorSize], &txData[j * SectorSize], SectorSize);
+    }
+    journalLock->Release();
+    return i;
 }
 
+//----------------------------------------------------------------------
+// SynchDisk::Overlay
+// 	Copy the sectors of the current transaction that are among 
+//	"count" read from "sectorNumber" over what was read.  Return FALSE
+//	instead if a transaction has been installed since "installs" was
+//	"since", as what was read may be older than what is cached now.
+//----------------------------------------------------------------------
+
 bool
-PipeFile::read(char *in, int len) {
-    lock->Acquire();
-    if (pipeLength + len > MAXPIPELEN) {
-        lock->Release();
-        return FALSE;;
-    }
-    readFile->Write(in, len);
-    pipeLength += len;
-    lock->Release();
+SynchDisk::Overlay(int sectorNumber, char* data, int count, int since)
+{
+    journalLock->Acquire();
+    if (installs != since) {
+        journalLock->Release();
+        return FALSE;
+    }
+    for (int j = 0; j < txCount; j++) {
+        int i = txSectors[j] - sectorNumber;
+
+        if (i >= 0 && i < count)
+            bcopy(&txData[j * SectorSize], &data[i * SectorSize], SectorSize);
+    }
+    journalLock->Release();
     return TRUE;
 }
 
-int 
-PipeFile::write(char *out) {
-    int len;
-    lock->Acquire();
-    if (pipeLength == 0) {
-        lock->Release();
-        return 0;
-    }
-    len = pipeLength;
-    pipeLength = 0;
-    readFile->Seek(0);
-    OpenFile *file = fileSystem->Open(path);
-    file->Read(out, len);
-    delete file;
-    lock->Release();
-
-    return len;
-}
\ No newline at end of file
+//----------------------------------------------------------------------
+// SynchDisk::Commit
+// 	Write the current transaction to the log, with a single request,
+//	and then install it: write its sectors to the cache, from where 
+//	they reach the disk in the usual way.  If the log is full, it is
+//	checkpointed first.
+//
+//	Called with journalLock held, and no operations outstanding; it
+//	is let go of meanwhile, but "committing" keeps anybody else from
+//	beginning an operation, or changing the transaction.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Commit()
+{
+    int blocks = txCount + divRoundUp(txCount, JournalTags);
+    char *log = new char[blocks * SectorSize];
+
+    committing = TRUE;
+    journalLock->Release();
+    for (int i = 0, b = 0, n; i < txCount; i += n, b += 1 + n) {
+        JournalBlock *block = (JournalBlock *) &log[b * SectorSize];
+        unsigned checksum;
+
+        n = (txCount - i < JournalTags) ? txCount - i : JournalTags;
+        bzero((char *) block, SectorSize);
+        block->magic = JournalMagic;
+        block->seq = journalSeq;
+        block->count = n;
+        block->last = (i + n == txCount);
+        bcopy((char *) &txSectors[i], (char *) block->sectors, 
+				n * sizeof(int));
+        bcopy(&txData[i * SectorSize], &log[(b + 1) * SectorSize], 
+				n * SectorSize);
+        checksum = JournalChecksum((char *) block, SectorSize, 
+				JournalHashBasis);
+        block->checksum = (int) JournalChecksum(&log[(b + 1) * SectorSize],
+				n * SectorSize, checksum);
+    }
+    if (journalHead + blocks > journalSectors)
+        Checkpoint();
+    DiskIO(journalStart + journalHead, log, TRUE, blocks);
+    for (int i = 0; i < txCount; i++)
+        CacheWrite(txSectors[i], &txData[i * SectorSize], 1);
+    delete [] log;
+
+    journalLock->Acquire();
+    journalHead += blocks;
+    journalSeq++;
+    txCount = 0;
+    installs++;
+    committing = FALSE;
+    stats->numJournalCommits++;
+    stats->numJournalBlocks += blocks;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Checkpoint
+// 	Empty the log: once every transaction in it has reached the disk
+//	proper, by syncing the cache, start the log over with the next 
+//	transaction.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Checkpoint()
+{
+    Sync();
+    WriteSuper();
+    journalHead = 1;
+    stats->numJournalCheckpoints++;
+}
+
+void
+SynchDisk::WriteSuper()
+{
+    JournalSuper super;
+
+    bzero((char *) &super, sizeof(super));
+    super.magic = JournalMagic;
+    super.seq = journalSeq;
+    super.sectors = journalSectors;
+    DiskIO(journalStart, (char *) &super, TRUE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadTransaction
+// 	Check that the transaction "journalSeq" is in the log, starting
+//	"at" blocks in, whole and intact, and with "install" write its 
+//	sectors.  Return how many blocks of the log it is, 0 if it isn't
+//	there.
+//----------------------------------------------------------------------
+
+int
+SynchDisk::ReadTransaction(int at, bool install)
+{
+    JournalBlock block;
+    char *data = new char[JournalTags * SectorSize];
+    int n = 0;
+
+    do {
+        int checksum;
+
+        if (at + n >= journalSectors) {
+            n = 0;
+            break;
+        }
+        DiskIO(journalStart + at + n, (char *) &block, FALSE);
+        if (block.magic != JournalMagic || block.seq != journalSeq
+		|| block.count <= 0 || block.count > JournalTags
+		|| at + n + 1 + block.count > journalSectors) {
+            n = 0;			// left from an older round, or 
+            break;			// never finished
+        }
+        DiskIO(journalStart + at + n + 1, data, FALSE, block.count);
+        checksum = block.checksum;
+        block.checksum = 0;
+        if (checksum != (int) JournalChecksum(data, block.count * SectorSize,
+		JournalChecksum((char *) &block, SectorSize, JournalHashBasis))) {
+            n = 0;
+            break;
+        }
+        if (install)
+            for (int i = 0; i < block.count; i++)
+                CacheWrite(block.sectors[i], &data[i * SectorSize], 1);
+        n += 1 + block.count;
+    } while (!block.last);
+    delete [] data;
+    return n;
+}
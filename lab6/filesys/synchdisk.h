@@ -17,6 +17,8 @@
 #include "synch.h"
 #endif
 
+class OpenFile;
+
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
 // requests to read or write portions of the disk return immediately,
@@ -27,10 +29,195 @@
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
 // returning.
+//
+// In front of the disk is a cache of recently used sectors, found by
+// hashing the sector number and replaced least recently used first.
+// Writes only go as far as the cache; a dirty sector reaches the disk
+// when it is replaced, when Sync is called, or when the flusher thread
+// finds that half the cache is dirty.  Whatever is still dirty when
+// Nachos halts is written out as it goes down.
+
+// Requests wait in a queue for the disk; when it finishes one, the next
+// is picked by the disk scheduling policy, from the tracks of the
+// waiting requests and of the head:
+//	FCFS -- in the order they came
+//	SSTF -- shortest seek first
+//	SCAN -- keep going in one direction while there are requests
+//		that way, then turn around (the elevator)
+//	CLOOK -- like SCAN, but only ever moving up; after the highest 
+//		request, jump back to the lowest
+// A request can be submitted and waited for later (cf. DiskRequest).
+//
+// A request can be for a run of consecutive sectors, which costs only 
+// one seek and rotational delay.  Writing back the cache, and reading
+// a run of sectors that aren't cached, are done in runs of up to
+// MaxTransfer sectors.
+//
+// The sectors can be striped across several disks (RAID 0): the first
+// StripeSectors sectors are on the first disk, the next StripeSectors
+// on the second, and so on round.  Each disk has a queue of its own, 
+// and interrupts of its own, so requests to different disks proceed 
+// at the same time.  A request that covers more than one stripe is
+// split into one request for each, which also proceed at the same
+// time, and is done when they all are.  Disk i of n is the UNIX file
+// "name.i"; with just one disk, it is "name".
+//
+// The file system's metadata can be journaled (StartJournal).  The
+// writes a thread makes between BeginOp and EndOp are kept aside, in
+// the current transaction, rather than cached; reads see them there.
+// So are other writes to sectors the transaction already has.
+// When the last operation in it ends, the transaction is committed: 
+// appended to the log, a reserved run of sectors, in one request, and 
+// only then put in the cache, to reach their own sectors whenever.  
+// So concurrent operations share a commit (group commit).  When the 
+// log is full, the cache is synced and the log begun again.  On mount,
+// the transactions in the log are replayed, so the metadata is as it 
+// was after the last commit, whenever Nachos went down.
+
+enum DiskPolicy { FCFS, SSTF, SCAN, CLOOK };
+
+class DiskRequest {
+  public:
+    DiskRequest(int sectorNumber, char* data, bool writing, int count = 1);
+    ~DiskRequest();
+
+    int sector;				// the first sector
+    int count;				// how many
+    char *data;
+    bool writing;
+    Semaphore *done;			// V'ed when the request is done
+    DiskRequest *next;			// in the queue
+
+    int unit;				// which disk it is queued for
+    int where;				// and the first sector on it
+    DiskRequest *parts;			// if it was split up, the requests
+    DiskRequest *nextPart;		// for each stripe
+
+    int thread;				// tid of the thread that queued it
+    int submitted;			// when it was queued
+    int started;			// when the disk was given it
+    int seek, rotation;			// ticks of it spent before transfer
+};
+
+// With "-iotrace file", a SynchDisk writes a record for each request 
+// its disks finish, in the order they finish, after a header of two 
+// ints: IOTraceMagic and sizeof(IOTraceRecord).  Times are in ticks; 
+// "service" is from when the disk was given the request until it was 
+// done, and includes "seek" and "rotation".  "-iosum file" prints a
+// summary of such a trace.
+
+#define IOTraceMagic	0x494f5452	// "IOTR"
+
+class IOTraceRecord {
+  public:
+    int done;				// when it finished
+    int sector;				// the first sector, on the volume
+    int count;
+    int writing;
+    int unit;				// which disk did it
+    int thread;				// tid of the thread that queued it
+    int queueWait;			// ticks from queued to started
+    int seek;
+    int rotation;
+    int service;
+};
+
+#define StripeSectors	4		// consecutive sectors on one disk
+#define MaxDisks	8
+
+class SynchDisk;
+
+// One of the disks of a SynchDisk, with its own queue.  The queue is 
+// protected by turning off interrupts.
+
+class DiskUnit {
+  public:
+    Disk *disk;
+    DiskRequest *queue;			// waiting requests, in the order
+					// they came
+    DiskRequest *active;		// the one the disk is doing, if any
+    bool scanUp;			// SCAN: which way the head is going
+    SynchDisk *volume;			// which this is one of
+};
+
+#define MaxTransfer	SectorsPerTrack	// longest run the cache writes back
+#define OpenBuckets	31		// hash chains of open file headers
+#define CacheSectors	64		// sectors in the cache, by default
+#define CacheBuckets	61		// hash chains
+
+class CacheEntry {
+  public:
+    int sector;				// which sector this is, if valid
+    bool valid;
+    bool dirty;				// changed since read or written
+    bool busy;				// being read or written; hands off
+    char data[SectorSize];
+    CacheEntry *hashNext;		// next in the same hash chain
+    CacheEntry *newer, *older;		// LRU order
+};
+
+// A file header that is open, with the reader/writer lock the OpenFiles
+// on it share.  There is one of these for each file that is open (or
+// being removed), rather than one for each sector of the disk; it is 
+// made when the file is first opened, and goes when it is last closed.
+
+class OpenHeader {
+  public:
+    int sector;				// where the header is
+    int count;				// OpenFiles on it; -1 while the
+					// file is being removed
+    int version;			// bumped by every Write to the file
+    OpenFile *appender;			// has bytes appended to the file 
+					// that are not written yet
+    ReaderWriterLock *lock;		// readers and writers of the file
+    OpenHeader *next;			// in the same hash chain
+};
+
+// The log is a JournalSuper sector, and then each transaction as one
+// or more JournalBlocks, each followed by the data blocks it lists.
+// A transaction is replayed only if every block of it checks out; the
+// transactions replayed are those following in sequence from "seq" in
+// the JournalSuper.
+
+#define JournalMinSectors 128		// the log, with its JournalSuper,
+					// when the free map is one sector
+#define JournalOpSectors 20		// sectors an operation may write,
+					// besides the bitmap and index 
+					// sectors for new data
+#define JournalMaxOps	16		// operations in one transaction
+#define JournalMagic	0x4a524e4c	// "JRNL"
+#define JournalTags	((int) (SectorSize / sizeof(int)) - 5)
+#define JournalMapSectors divRoundUp(NumSectors, BitsInByte * SectorSize)
+					// sectors of the free map
+#define JournalSectors	(JournalMinSectors + divRoundUp( \
+			(JournalMapSectors - 1) * (JournalTags + 1), JournalTags))
+					// the log of a new disk: big enough
+					// for every free map sector as well
+
+class JournalBlock {
+  public:
+    int magic;
+    int seq;				// which transaction
+    int count;				// the blocks following this one
+    int last;				// the last JournalBlock of it?
+    int checksum;			// of this, with 0 here, and them
+    int sectors[JournalTags];		// where each of them goes
+};
+
+class JournalSuper {
+  public:
+    int magic;
+    int seq;				// the first transaction in the log
+    int sectors;			// the size of the log
+    char unused[SectorSize - 3 * sizeof(int)];
+};
+
 class SynchDisk {
   public:
-    SynchDisk(char* name);    		// Initialize a synchronous disk,
-					// by initializing the raw Disk.
+    SynchDisk(char* name, int cacheSectors = CacheSectors, int disks = 1);
+    					// Initialize a synchronous disk,
+					// by initializing the raw Disks;
+					// 0 "cacheSectors" means no cache
     ~SynchDisk();			// De-allocate the synch disk data
     
     void ReadSector(int sectorNumber, char* data);
@@ -40,36 +227,129 @@ class SynchDisk {
     					// Disk::ReadRequest/WriteRequest and
 					// then wait until the request is done.
     void WriteSector(int sectorNumber, char* data);
+    void ReadSectors(int sectorNumber, char* data, int count);
+    void WriteSectors(int sectorNumber, char* data, int count);
+    					// the same, for "count" consecutive
+					// sectors at once
     
-    void RequestDone();			// Called by the disk device interrupt
+    void Sync();			// write every dirty sector to disk
+
+    void Submit(DiskRequest *request);	// queue a request, and return
+    void Wait(DiskRequest *request);	// wait until it is done
+    void Prefetch(DiskRequest *request);	// Submit a read, once the 
+					// disk has the latest data for it
+    void setPolicy(DiskPolicy p) { diskPolicy = p; }
+    DiskPolicy getPolicy() { return diskPolicy; }
+
+    int getNumDisks() { return numDisks; }
+    void StartTrace(char *traceName);	// record every request done to
+					// the UNIX file "traceName"
+
+    bool StartJournal(int sector, bool format);	// replay, and then use,
+					// the log at "sector", or with
+					// "format" begin an empty one;
+					// FALSE if the disk has no log
+    void BeginOp(int extra = 0);	// the writes of this thread until
+    void EndOp();			// EndOp are one atomic update, of
+					// up to "extra" more sectors than
+					// usual
+
+    void RequestDone(DiskUnit *unit);	// Called by the disk device interrupt
 					// handler, to signal that the
 					// current disk operation is complete.
+    void Flusher();			// body of the flusher thread
     
-    ReaderWriterLock *hdrLocks[NumSectors];
-    int openFileCount[NumSectors];
-    Lock *countLock[NumSectors];
+    bool HeaderOpened(int sector);	// one more OpenFile on the header
+					// at "sector"; FALSE if the file
+					// is being removed
+    void HeaderClosed(int sector);	// one fewer
+    bool HeaderRemoving(int sector);	// FALSE if the file is open; else
+					// keep it from being opened until
+    void HeaderRemoved(int sector);	// it is gone
+    ReaderWriterLock *HeaderLock(int sector);	// the lock of an open file
+    int HeaderVersion(int sector);	// how many times an open file has
+    void HeaderWritten(int sector);	// been written to, and one more
+    OpenFile *HeaderAppender(int sector);	// the OpenFile with appends
+    void SetHeaderAppender(int sector, OpenFile *file);	// held back
 
   private:
-    Disk *disk;		  		// Raw disk device
-    Semaphore *semaphore; 		// To synchronize requesting thread 
-					// with the interrupt handler
-    Lock *lock;		  		// Only one read/write request
-					// can be sent to the disk at a time
-};
+    int numDisks;
+    DiskUnit *units;	  		// the raw disk devices
+    DiskPolicy diskPolicy;
+    int traceFile;			// UNIX file for the I/O trace, or -1
 
+    DiskUnit *Locate(int sectorNumber, int *where);
+					// which disk a sector is on, and
+					// where on it
+    void Queue(DiskRequest *request);	// queue a request for one disk
+    void StartNext(DiskUnit *u);	// give a disk its next request
+    void DiskIO(int sectorNumber, char* data, bool writing, int count = 1);
+					// do the request, and wait for it
+    void CacheRead(int sectorNumber, char* data, int count);
+    void CacheWrite(int sectorNumber, char* data, int count);
+					// Read/WriteSectors, without the
+					// journal
 
+    bool journalOn;			// are metadata writes journaled?
+    int journalStart;			// the JournalSuper
+    int journalSectors;			// the size of the log
+    int journalHead;			// the next free block of the log
+    int journalSeq;			// the next transaction
+    int maxTx;				// the most sectors one can hold
+    int bitmapSectors;			// how many the free map is
+    Thread *opThread[JournalMaxOps];	// threads between BeginOp and
+    int opDepth[JournalMaxOps];		// EndOp, how deep, and how many
+    int opReserve[JournalMaxOps];	// sectors they might yet add
+    int outstanding, reserved;		// their sum
+    bool committing;			// the transaction is being written
+    int installs;			// transactions put in the cache
+    int txCount;			// the current transaction: sectors,
+    int *txSectors;			// where they go, and their data
+    char *txData;
+    Lock *journalLock;			// protects all of the journal
+    Condition *journalIdle;		// a commit or an operation ended
 
-class PipeFile {
-  public:
-    PipeFile(char *_path);
-    ~PipeFile();
-    bool open();
-    int write(char *out);
-    bool read(char *in, int len);
-  private:
-    Lock *lock;
-    int pipeLength;
-    char *path;
-    OpenFile *readFile;
+    int FindOp(Thread *t);		// which opThread it is, or -1
+    int LogWrite(int sectorNumber, char* data, int count, bool *held);
+					// how many of the sectors went to
+					// the transaction, or ("held" FALSE)
+					// are left for the cache
+    bool Overlay(int sectorNumber, char* data, int count, int since);
+					// copy the transaction's sectors in;
+					// FALSE if one was installed since
+    void Commit();			// log, and install, the transaction
+    void Checkpoint();			// sync, and empty the log
+    void WriteSuper();
+    int ReadTransaction(int at, bool install);	// check, and maybe
+					// install, the one at "at" in the
+					// log: its size, or 0 if not valid
+
+    int numEntries;			// size of the cache, maybe 0
+    CacheEntry *entries;
+    CacheEntry *buckets[CacheBuckets];
+    CacheEntry *newest, *oldest;	// ends of the LRU list
+    int numDirty;
+    Lock *cacheLock;			// protects all of the cache
+    Condition *ioDone;			// an entry is no longer busy
+    Condition *flushNeeded;		// the flusher waits here
+
+    OpenHeader *openHeaders[OpenBuckets];
+    Lock *openLock;			// protects openHeaders
+    OpenHeader **FindHeader(int sector);	// where it is, or would be,
+					// in its hash chain
+
+    CacheEntry *Lookup(int sectorNumber);	// NULL if not cached
+    CacheEntry *GetEntry(int sectorNumber, bool fill, bool *fresh = NULL);
+					// entry holding the sector, read
+					// in first if "fill"; "fresh" is
+					// set if it wasn't cached
+    void Touch(CacheEntry *e);		// make "e" the most recently used
+    void Replace(CacheEntry *e, int sectorNumber);	// reuse it for
+					// another sector
+    void Unhash(CacheEntry *e);
+    void WriteBack(CacheEntry *e);	// write out a dirty entry, and the
+					// dirty ones just after it
 };
+
+
 #endif // SYNCHDISK_H
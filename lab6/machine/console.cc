@@ -54,6 +54,7 @@ Console::Console(char *readFile, char *writeFile, VoidFunctionPtr readAvail,
     handlerArg = callArg;
     putBusy = FALSE;
     incoming = EOF;
+    atEnd = FALSE;
 
     // start polling for incoming packets
     interrupt->Schedule(ConsoleReadPoll, (int)this, ConsoleTime, ConsoleReadInt);
@@ -80,7 +81,8 @@ Console::~Console()
 //	Only read it in if there is buffer space for it (if the previous
 //	character has been grabbed out of the buffer by the Nachos kernel).
 //	Invoke the "read" interrupt handler, once the character has been 
-//	put into the buffer. 
+//	put into the buffer.  At the end of the file, stop polling, and
+//	invoke it one last time with nothing in the buffer.
 //----------------------------------------------------------------------
 
 void
@@ -88,6 +90,9 @@ Console::CheckCharAvail()
 {
     char c;
 
+    if (atEnd)
+        return;				// nothing more will ever come
+
     // schedule the next time to poll for a packet
     interrupt->Schedule(ConsoleReadPoll, (int)this, ConsoleTime, 
 			ConsoleReadInt);
@@ -97,7 +102,11 @@ Console::CheckCharAvail()
 	    return;	  
 
     // otherwise, read character and tell user about it
-    Read(readFileNo, &c, sizeof(char));
+    if (ReadPartial(readFileNo, &c, sizeof(char)) <= 0) {
+        atEnd = TRUE;
+        (*readHandler)(handlerArg);
+        return;
+    }
     incoming = c ;
     stats->numConsoleCharsRead++;
     (*readHandler)(handlerArg);	
@@ -165,7 +174,8 @@ static void WriteDoneHandler(int arg) {
 
 SynchConsole::SynchConsole(char *readFile, char *writeFile)
 {
-    lock = new Lock("console lock");
+    readLock = new Lock("console read lock");
+    writeLock = new Lock("console write lock");
     readAvail = new Semaphore("read avail", 0);
     writeDone = new Semaphore("write done", 0);
     console = new Console(readFile, writeFile, ReadAvailHandler, WriteDoneHandler, (int) this);
@@ -176,28 +186,73 @@ SynchConsole::~SynchConsole()
     delete console;
     delete writeDone;
     delete readAvail;
-    delete lock;
+    delete writeLock;
+    delete readLock;
 }
 
 void
 SynchConsole::PutChar(char ch)
 {
-    lock->Acquire();
+    writeLock->Acquire();
     console->PutChar(ch);
     writeDone->P();
-    lock->Release();
+    writeLock->Release();
 }
 
 char
 SynchConsole::GetChar()
 {
-    lock->Acquire();
+    readLock->Acquire();
     readAvail->P();
     char ch = console->GetChar();
-    lock->Release();
+    readLock->Release();
     return ch;
 }
 
+//----------------------------------------------------------------------
+// SynchConsole::Read
+// 	Read from the keyboard, up to "numBytes" bytes or the end of the
+//	line, whichever comes first.  Waits for at least one byte, unless
+//	the input has run out.
+//----------------------------------------------------------------------
+
+int
+SynchConsole::Read(char *into, int numBytes)
+{
+    int n = 0;
+
+    readLock->Acquire();
+    while (n < numBytes) {
+        readAvail->P();
+        if (console->AtEnd()) {
+            readAvail->V();		// so that later reads see it too
+            break;
+        }
+        into[n] = console->GetChar();
+        if (into[n++] == '\n')
+            break;
+    }
+    readLock->Release();
+    return n;
+}
+
+//----------------------------------------------------------------------
+// SynchConsole::Write
+// 	Write "numBytes" bytes to the display, without any other writer's
+//	output getting in between.
+//----------------------------------------------------------------------
+
+void
+SynchConsole::Write(char *from, int numBytes)
+{
+    writeLock->Acquire();
+    for (int i = 0; i < numBytes; i++) {
+        console->PutChar(from[i]);
+        writeDone->P();
+    }
+    writeLock->Release();
+}
+
 void
 SynchConsole::ReadAvail()
 {
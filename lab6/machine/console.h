@@ -55,6 +55,8 @@ class Console {
 				// available, return it.  Otherwise, return EOF.
     				// "readHandler" is called whenever there is 
 				// a char to be gotten
+    bool AtEnd() { return atEnd; }	// TRUE once the input has run out;
+				// "readHandler" is called once more then
 
 // internal emulation routines -- DO NOT call these. 
     void WriteDone();	 	// internal routines to signal I/O completion
@@ -74,21 +76,31 @@ class Console {
     char incoming;    			// Contains the character to be read,
 					// if there is one available. 
 					// Otherwise contains EOF.
+    bool atEnd;				// end of the input file was reached,
+					// so polling has stopped
 };
 
+// The following class puts a synchronous interface on the console: a
+// thread reading or writing waits for the device, while other threads
+// run.  Reads and writes are serialized separately, so that a thread
+// waiting for a key does not hold up output.
+
 class SynchConsole {
   public:
     SynchConsole(char *readFile, char *writeFile);
     ~SynchConsole();
     void PutChar(char ch);
     char GetChar();
+    int Read(char *into, int numBytes);	// up to the end of a line
+    void Write(char *from, int numBytes);	// all of it, in one piece
     void ReadAvail();
     void WriteDone();
   private:
     Console *console;
     Semaphore *readAvail;
     Semaphore *writeDone;
-    Lock *lock;
+    Lock *readLock;			// one reader at a time
+    Lock *writeLock;			// one writer at a time
 };
 
 #endif // CONSOLE_H
@@ -19,11 +19,16 @@
 
 // We put this at the front of the UNIX file representing the
 // disk, to make it less likely we will accidentally treat a useful file 
-// as a disk (which would probably trash the file's contents).
-#define MagicNumber 	0x456789ab
+// as a disk (which would probably trash the file's contents).  After
+// it come the sector size, the sectors per track and the tracks.
+// A disk with the old magic number, and nothing after it, is 32 
+// tracks of 32 sectors of 128 bytes.
+#define MagicNumber 	0x456789ac
+#define OldMagicNumber 	0x456789ab
 #define MagicSize 	sizeof(int)
+#define HeaderSize 	(4 * sizeof(int))
 
-#define DiskSize 	(MagicSize + (NumSectors * SectorSize))
+#define MaxDiskSize	0x7fffffff	// the UNIX file is addressed with ints
 
 // dummy procedure because we can't take a pointer of a member function
 static void DiskDone(int arg) { ((Disk *)arg)->HandleInterrupt(); }
@@ -32,39 +37,77 @@ static void DiskDone(int arg) { ((Disk *)arg)->HandleInterrupt(); }
 // Disk::Disk()
 // 	Initialize a simulated disk.  Open the UNIX file (creating it
 //	if it doesn't exist), and check the magic number to make sure it's 
-// 	ok to treat it as Nachos disk storage.
+// 	ok to treat it as Nachos disk storage.  The geometry is taken
+//	from the file if it has one, or else written into it.
 //
 //	"name" -- text name of the file simulating the Nachos disk
 //	"callWhenDone" -- interrupt handler to be called when disk read/write
 //	   request completes
 //	"callArg" -- argument to pass the interrupt handler
+//	"tracks" -- how many tracks a new disk has; 0 for NumTracks
 //----------------------------------------------------------------------
 
-Disk::Disk(char* name, VoidFunctionPtr callWhenDone, int callArg)
+Disk::Disk(char* name, VoidFunctionPtr callWhenDone, int callArg, int tracks)
 {
     int magicNum;
+    int geometry[3];			// sector size, sectors per track,
+					// tracks
     int tmp = 0;
+    bool created = FALSE;
 
     DEBUG('d', "Initializing the disk, 0x%x 0x%x\n", callWhenDone, callArg);
     handler = callWhenDone;
     handlerArg = callArg;
     lastSector = 0;
     bufferInit = 0;
+    seekTicks = rotationTicks = 0;
     
     fileno = OpenForReadWrite(name, FALSE);
     if (fileno >= 0) {		 	// file exists, check magic number 
 	Read(fileno, (char *) &magicNum, MagicSize);
-	ASSERT(magicNum == MagicNumber);
+	if (magicNum == OldMagicNumber) {
+	    geometry[0] = 128;
+	    geometry[1] = geometry[2] = 32;
+	    headerSize = MagicSize;
+	} else {
+	    ASSERT(magicNum == MagicNumber);
+	    Read(fileno, (char *) geometry, sizeof(geometry));
+	    headerSize = HeaderSize;
+	}
+	ASSERT(geometry[0] == SectorSize);	// Nachos was compiled for 
+						// another size of sector
+	diskSectorsPerTrack = geometry[1];
     } else {				// file doesn't exist, create it
         fileno = OpenForWrite(name);
 	magicNum = MagicNumber;  
+	geometry[0] = SectorSize;
+	geometry[1] = SectorsPerTrack;
+	geometry[2] = (tracks > 0) ? tracks : NumTracks;
 	WriteFile(fileno, (char *) &magicNum, MagicSize); // write magic number
-
+	WriteFile(fileno, (char *) geometry, sizeof(geometry));
+	headerSize = HeaderSize;
+	created = TRUE;
+    }
+    numTracks = geometry[2];
+    ASSERT((SectorsPerTrack > 0) && (numTracks > 0) 
+	    && (numTracks <= (MaxDiskSize - headerSize) 
+				/ SectorSize / SectorsPerTrack));
+    numSectors = SectorsPerTrack * numTracks;
+    diskSize = headerSize + numSectors * SectorSize;
+    DEBUG('d', "Disk of %d tracks of %d sectors of %d bytes\n", 
+	  numTracks, SectorsPerTrack, SectorSize);
+    if (created) {
 	// need to write at end of file, so that reads will not return EOF
-        Lseek(fileno, DiskSize - sizeof(int), 0);	
+        Lseek(fileno, diskSize - sizeof(int), 0);	
 	WriteFile(fileno, (char *)&tmp, sizeof(int));  
     }
     active = FALSE;
+
+    image = NULL;
+    syncEvery = diskSyncEvery;
+    writesSinceSync = 0;
+    if (diskMapped)
+        image = MapFile(fileno, diskSize);
 }
 
 //----------------------------------------------------------------------
@@ -75,6 +118,10 @@ Disk::Disk(char* name, VoidFunctionPtr callWhenDone, int callArg)
 
 Disk::~Disk()
 {
+    if (image != NULL) {
+        SyncMappedFile(image, diskSize);
+        UnmapFile(image, diskSize);
+    }
     Close(fileno);
 }
 
@@ -99,59 +146,119 @@ PrintSector (bool writing, int sector, char *data)
 
 //----------------------------------------------------------------------
 // Disk::ReadRequest/WriteRequest
-// 	Simulate a request to read/write a single disk sector
+// 	Simulate a request to read/write a run of consecutive disk sectors
 //	   Do the read/write immediately to the UNIX file
 //	   Set up an interrupt handler to be called later,
 //	      that will notify the caller when the simulator says
 //	      the operation has completed.
 //
+//	The run costs one seek and rotational delay, to its first sector, 
+//	and then the time for each sector to pass under the head.
+//
 //	Note that a disk only allows an entire sector to be read/written,
 //	not part of a sector.
 //
-//	"sectorNumber" -- the disk sector to read/write
+//	"sectorNumber" -- the first disk sector to read/write
 //	"data" -- the bytes to be written, the buffer to hold the incoming bytes
+//	"count" -- how many sectors
 //----------------------------------------------------------------------
 
 void
-Disk::ReadRequest(int sectorNumber, char* data)
+Disk::ReadRequest(int sectorNumber, char* data, int count)
 {
-    int ticks = ComputeLatency(sectorNumber, FALSE);
+    int ticks = ComputeLatency(sectorNumber, FALSE) 
+			+ (count - 1) * RotationTime;
+    int rotation;
 
     ASSERT(!active);				// only one request at a time
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT((sectorNumber >= 0) && (count > 0) 
+			&& (sectorNumber + count <= numSectors));
     
-    DEBUG('d', "Reading from sector %d\n", sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
+    DEBUG('d', "Reading from sector %d, %d sectors\n", sectorNumber, count);
+    Transfer(sectorNumber, data, count, FALSE);
     if (DebugIsEnabled('d'))
-	PrintSector(FALSE, sectorNumber, data);
+	for (int i = 0; i < count; i++)
+	    PrintSector(FALSE, sectorNumber + i, data + i * SectorSize);
     
     active = TRUE;
-    UpdateLast(sectorNumber);
+    stats->diskSeekTicks += TimeToSeek(sectorNumber, &rotation);
+    UpdateLast(sectorNumber + count - 1);
     stats->numDiskReads++;
     interrupt->Schedule(DiskDone, (int) this, ticks, DiskInt);
 }
 
 void
-Disk::WriteRequest(int sectorNumber, char* data)
+Disk::WriteRequest(int sectorNumber, char* data, int count)
 {
-    int ticks = ComputeLatency(sectorNumber, TRUE);
+    int ticks = ComputeLatency(sectorNumber, TRUE)
+			+ (count - 1) * RotationTime;
+    int rotation;
 
     ASSERT(!active);
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT((sectorNumber >= 0) && (count > 0) 
+			&& (sectorNumber + count <= numSectors));
     
-    DEBUG('d', "Writing to sector %d\n", sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
+    DEBUG('d', "Writing to sector %d, %d sectors\n", sectorNumber, count);
+    Transfer(sectorNumber, data, count, TRUE);
     if (DebugIsEnabled('d'))
-	PrintSector(TRUE, sectorNumber, data);
+	for (int i = 0; i < count; i++)
+	    PrintSector(TRUE, sectorNumber + i, data + i * SectorSize);
     
     active = TRUE;
-    UpdateLast(sectorNumber);
+    stats->diskSeekTicks += TimeToSeek(sectorNumber, &rotation);
+    UpdateLast(sectorNumber + count - 1);
     stats->numDiskWrites++;
     interrupt->Schedule(DiskDone, (int) this, ticks, DiskInt);
 }
 
+//----------------------------------------------------------------------
+// Disk::Transfer
+// 	Copy "count" sectors from the UNIX file into "data", or the other
+//	way if "writing": through the mapping if there is one, or else 
+//	with a single system call.
+//----------------------------------------------------------------------
+
+void
+Disk::Transfer(int sectorNumber, char* data, int count, bool writing)
+{
+    int offset = SectorSize * sectorNumber + headerSize;
+
+    if (image == NULL) {
+        if (writing)
+            WriteFileAt(fileno, data, SectorSize * count, offset);
+        else
+            ReadFileAt(fileno, data, SectorSize * count, offset);
+        return;
+    }
+    if (!writing) {
+        memcpy(data, image + offset, SectorSize * count);
+        return;
+    }
+    memcpy(image + offset, data, SectorSize * count);
+    if (syncEvery > 0 && ++writesSinceSync >= syncEvery) {
+        SyncMappedFile(image, diskSize);
+        writesSinceSync = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// Disk::WriteNow
+// 	Write a sector to the UNIX file straight away.  Used when Nachos
+//	is shutting down and there is nobody left to take an interrupt.
+//	The write is counted, but takes no simulated time.
+//----------------------------------------------------------------------
+
+void
+Disk::WriteNow(int sectorNumber, char* data)
+{
+    ASSERT(!active);
+    ASSERT((sectorNumber >= 0) && (sectorNumber < numSectors));
+
+    DEBUG('d', "Writing to sector %d at shutdown\n", sectorNumber);
+    Transfer(sectorNumber, data, 1, TRUE);
+    stats->numDiskWrites++;
+}
+
 //----------------------------------------------------------------------
 // Disk::HandleInterrupt()
 // 	Called when it is time to invoke the disk interrupt handler,
@@ -227,6 +334,8 @@ Disk::ModuloDiff(int to, int from)
 //   	read requests to the current track to be satisfied more quickly.
 //   	The contents of the track buffer are discarded after every seek to 
 //   	a new track.
+//
+//	The seek and rotational delay are kept, for the I/O trace.
 //----------------------------------------------------------------------
 
 int
@@ -242,6 +351,7 @@ Disk::ComputeLatency(int newSector, bool writing)
 		&& (((timeAfter - bufferInit) / RotationTime) 
 	     		> ModuloDiff(newSector, bufferInit / RotationTime))) {
         DEBUG('d', "Request latency = %d\n", RotationTime);
+        seekTicks = rotationTicks = 0;
 	return RotationTime; // time to transfer sector from the track buffer
     }
 #endif
@@ -249,6 +359,8 @@ Disk::ComputeLatency(int newSector, bool writing)
     rotation += ModuloDiff(newSector, timeAfter / RotationTime) * RotationTime;
 
     DEBUG('d', "Request latency = %d\n", seek + rotation + RotationTime);
+    seekTicks = seek;
+    rotationTicks = rotation;
     return(seek + rotation + RotationTime);
 }
 
@@ -45,31 +45,77 @@
 // disks these days now come with a track buffer.
 //
 // The track buffer simulation can be disabled by compiling with -DNOTRACKBUF
+//
+// With "-mmap", the UNIX file is mapped into memory, and sectors are
+// copied in and out of the mapping instead of with a system call each.
+// The changes reach the file when the kernel gets round to it, when 
+// the disk is deleted, and, with "-msync n", after every n writes.
+// The simulated timing is the same either way.
+
+//
+// The geometry of the disk is kept in a header at the front of the UNIX
+// file, and read back whenever the disk is opened, so the same Nachos
+// can use disks of any size up to 2GB.  A single file on one is still
+// limited by its header to MaxFileSize (filehdr.h), 131968 bytes with
+// 128-byte sectors.  A new disk gets the geometry given with "-dg s t":
+// s sectors per track and t tracks (default 32 and 32).  Sectors can be bigger than 128 bytes, but file headers
+// and directory entries are laid out a sector at a time, so the size
+// is chosen when Nachos is compiled (-DSECTOR_SIZE=n), and the disk
+// must have been made with the same size.
+//
+// A disk can be one of several that a SynchDisk stripes a volume 
+// across; SectorsPerTrack and NumTracks are then those of the volume, 
+// and each disk has NumTracks divided by the number of disks.
 
+#ifdef SECTOR_SIZE
+#define SectorSize 		SECTOR_SIZE
+#else
 #define SectorSize 		128	// number of bytes per disk sector
-#define SectorsPerTrack 	32	// number of sectors per disk track 
-#define NumTracks 		32	// number of tracks per disk
+#endif
+#define SectorsPerTrack 	diskSectorsPerTrack
+					// number of sectors per disk track 
+#define NumTracks 		diskNumTracks	// number of tracks per disk
 #define NumSectors 		(SectorsPerTrack * NumTracks)
 					// total # of sectors per disk
 
+#define DefaultSectorsPerTrack	32	// for a new disk, unless "-dg"
+#define DefaultNumTracks	32
+
+extern int diskSectorsPerTrack;		// the geometry of the disk; set
+extern int diskNumTracks;		// by "-dg", then from the disk
+					// images once they are opened
+
 class Disk {
   public:
-    Disk(char* name, VoidFunctionPtr callWhenDone, int callArg);
+    Disk(char* name, VoidFunctionPtr callWhenDone, int callArg,
+		int tracks = 0);
     					// Create a simulated disk.  
 					// Invoke (*callWhenDone)(callArg) 
 					// every time a request completes.
+					// A new disk has "tracks" tracks,
+					// or NumTracks if 0
     ~Disk();				// Deallocate the disk.
     
-    void ReadRequest(int sectorNumber, char* data);
-    					// Read/write an single disk sector.
+    void ReadRequest(int sectorNumber, char* data, int count = 1);
+    					// Read/write "count" consecutive disk
+					// sectors, starting at sectorNumber.
 					// These routines send a request to 
     					// the disk and return immediately.
     					// Only one request allowed at a time!
-    void WriteRequest(int sectorNumber, char* data);
+    void WriteRequest(int sectorNumber, char* data, int count = 1);
+    void WriteNow(int sectorNumber, char* data);
+					// Write a sector at once, with no
+					// interrupt; only for shutdown, when
+					// simulated time has stopped
 
     void HandleInterrupt();		// Interrupt handler, invoked when
 					// disk request finishes.
 
+    int getLastSector() { return lastSector; }	// where the head is
+    int getNumTracks() { return numTracks; }
+    int getSeekTicks() { return seekTicks; }	// of the last request
+    int getRotationTicks() { return rotationTicks; }
+
     int ComputeLatency(int newSector, bool writing);	
     					// Return how long a request to 
 					// newSector will take: 
@@ -77,6 +123,17 @@ class Disk {
 
   private:
     int fileno;				// UNIX file number for simulated disk 
+    int headerSize;			// bytes in front of sector 0
+    int numTracks;			// on this disk
+    int numSectors;
+    int diskSize;			// bytes in the UNIX file
+    char *image;			// the file, mapped; NULL if not mapped
+    int syncEvery;			// msync after this many writes; 0
+					// for only at the end
+    int writesSinceSync;
+
+    void Transfer(int sectorNumber, char* data, int count, bool writing);
+					// copy sectors to or from the file
     VoidFunctionPtr handler;		// Interrupt handler, to be invoked 
 					// when any disk request finishes
     int handlerArg;			// Argument to interrupt handler 
@@ -84,6 +141,8 @@ class Disk {
     int lastSector;			// The previous disk request 
     int bufferInit;			// When the track buffer started 
 					// being loaded
+    int seekTicks;			// how ComputeLatency last split up
+    int rotationTicks;			// the time, before the transfer
 
     int TimeToSeek(int newSector, int *rotate); // time to get to the new track
     int ModuloDiff(int to, int from);        // # sectors between to and from
@@ -48,6 +48,7 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int time,
     arg = param;
     when = time;
     type = kind;
+    next = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -60,7 +61,9 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int time,
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new List();
+    pending = new Heap();
+    freePending = NULL;
+    nextDeadline = -1;
     inHandler = FALSE;
     yieldOnReturn = FALSE;
     status = SystemMode;
@@ -73,9 +76,15 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
+    PendingInterrupt *p;
+
     while (!pending->IsEmpty())
-	delete (PendingInterrupt *)pending->Remove();
+	delete (PendingInterrupt *)pending->RemoveMin();
     delete pending;
+    while ((p = freePending) != NULL) {
+        freePending = p->next;
+        delete p;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -146,22 +155,48 @@ Interrupt::Enable()
 //	Two things can cause OneTick to be called:
 //		interrupts are re-enabled
 //		a user instruction is executed
+//
+//	Both happen all the time, and nearly always nothing is due and 
+//	nobody should preempt us.  So once the time is charged, that is
+//	checked against the cached next deadline and the scheduler's 
+//	cached answer, and we return; only a tick with something to do
+//	goes on to fire interrupts and yield.  "-slowtick" turns the 
+//	short cut off, "-tc" checks it.
 //----------------------------------------------------------------------
 void
 Interrupt::OneTick()
 {
     MachineStatus old = status;
 
+    if (scheduler->getNumCpus() > 1) {
+        MultiCpuTick();
+        return;
+    }
+
 // advance simulated time
     if (status == SystemMode) {
         stats->totalTicks += SystemTick;
 	    stats->systemTicks += SystemTick;
+        currentThread->chargeTicks(FALSE, SystemTick);
     } else {					// USER_PROGRAM
         stats->totalTicks += UserTick;
         stats->userTicks += UserTick;
+        currentThread->chargeTicks(TRUE, UserTick);
     }
     DEBUG('i', "\n== Tick %d ==\n", stats->totalTicks);
 
+// nothing due, and nobody to preempt us?
+    if (!slowTick && !yieldOnReturn && !DebugIsEnabled('i')
+            && (nextDeadline == -1 || stats->totalTicks < nextDeadline)
+            && !scheduler->PreemptionNeeded()) {
+        if (traceCheck) {
+            ASSERT(nextDeadline == NextDeadline());
+            ASSERT(!scheduler->higherPriorityInList());
+        }
+        stats->numFastTicks++;
+        return;
+    }
+
 // check any pending interrupts are now ready to fire
     ChangeLevel(IntOn, IntOff);		// first, turn off interrupts
 					// (interrupt handlers run with
@@ -177,7 +212,7 @@ Interrupt::OneTick()
         status = old;
     }
 
-    if (scheduler->higherPriorityInList())
+    if (scheduler->PreemptionNeeded())
     {
         status = SystemMode;
         currentThread->Yield();
@@ -185,6 +220,64 @@ Interrupt::OneTick()
     }
 }
 
+//----------------------------------------------------------------------
+// Interrupt::MultiCpuTick
+// 	OneTick, when simulating more than one CPU (cf. Cpu in 
+//	scheduler.h).  The tick is charged to the current CPU's own
+//	clock.  Simulated time only moves, and interrupts only fire, when
+//	the slowest busy CPU has caught up.  Then the host goes to the 
+//	busy CPU that is furthest behind, which may be this one.
+//
+//	A yield asked for by an interrupt handler applies to the CPU the
+//	handler ran on; it, and timer preemption, happen when that CPU 
+//	next executes.
+//----------------------------------------------------------------------
+
+void
+Interrupt::MultiCpuTick()
+{
+    MachineStatus old = status;
+    int tick = (status == SystemMode) ? SystemTick : UserTick;
+    Cpu *next;
+
+    if (status == SystemMode)
+        stats->systemTicks += tick;
+    else
+        stats->userTicks += tick;
+    currentThread->chargeTicks(status != SystemMode, tick);
+    scheduler->getCpu()->clock += tick;
+    scheduler->getCpu()->busyTicks += tick;
+
+    ChangeLevel(IntOn, IntOff);
+    scheduler->StartIdleCpus();
+    next = scheduler->EarliestCpu();
+    if (next->clock > stats->totalTicks) {	// everybody has caught up
+        stats->totalTicks = next->clock;
+        DEBUG('i', "\n== Tick %d ==\n", stats->totalTicks);
+        while (CheckIfDue(FALSE))
+            ;
+        if (yieldOnReturn) {
+            yieldOnReturn = FALSE;
+            scheduler->getCpu()->preempt = TRUE;
+        }
+        scheduler->StartIdleCpus();		// handlers may have woken
+        next = scheduler->EarliestCpu();	// someone up
+    }
+    if (next != scheduler->getCpu()) {
+        status = SystemMode;
+        scheduler->SwitchCpu(next);		// back when it is our turn
+        status = old;
+    }
+    ChangeLevel(IntOff, IntOn);
+
+    if (scheduler->getCpu()->preempt || scheduler->higherPriorityInList()) {
+        scheduler->getCpu()->preempt = FALSE;
+        status = SystemMode;
+        currentThread->Yield();
+        status = old;
+    }
+}
+
 //----------------------------------------------------------------------
 // Interrupt::YieldOnReturn
 // 	Called from within an interrupt handler, to cause a context switch
@@ -249,6 +342,12 @@ Interrupt::Halt()
 {
     printf("Machine halting!\n\n");
     stats->Print();
+    if (scheduler->getNumCpus() > 1)
+        scheduler->PrintCpus();
+    if (timer != NULL)
+        timer->Print();
+    if (psOnExit)
+        PS(FALSE);
     Cleanup();     // Never returns.
 }
 
@@ -257,7 +356,9 @@ Interrupt::Halt()
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: put it on a heap keyed on the time it is due.
+//	PendingInterrupt records are recycled once they have fired, so in
+//	steady state scheduling an interrupt allocates nothing.
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -272,13 +373,41 @@ void
 Interrupt::Schedule(VoidFunctionPtr handler, int arg, int fromNow, IntType type)
 {
     int when = stats->totalTicks + fromNow;
-    PendingInterrupt *toOccur = new PendingInterrupt(handler, arg, when, type);
+    PendingInterrupt *toOccur = freePending;
+
+    if (toOccur != NULL) {
+        freePending = toOccur->next;
+        toOccur->handler = handler;
+        toOccur->arg = arg;
+        toOccur->when = when;
+        toOccur->type = type;
+        toOccur->next = NULL;
+    } else
+        toOccur = new PendingInterrupt(handler, arg, when, type);
 
     DEBUG('i', "Scheduling interrupt handler the %s at time = %d\n", 
 					intTypeNames[type], when);
     ASSERT(fromNow > 0);
 
-    pending->SortedInsert(toOccur, when);
+    pending->Insert(toOccur, when);
+    if (nextDeadline == -1 || when < nextDeadline)
+        nextDeadline = when;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::NextDeadline
+// 	Return the time the earliest pending interrupt is due, or -1 if
+//	nothing is pending.  Until then, there is nothing to check.
+//----------------------------------------------------------------------
+
+int
+Interrupt::NextDeadline()
+{
+    int when;
+
+    if (pending->Min(&when) == NULL)
+        return -1;
+    return when;
 }
 
 //----------------------------------------------------------------------
@@ -305,7 +434,7 @@ Interrupt::CheckIfDue(bool advanceClock)
     if (DebugIsEnabled('i'))
 	DumpState();
     PendingInterrupt *toOccur = 
-		(PendingInterrupt *)pending->SortedRemove(&when);
+		(PendingInterrupt *)pending->Min(&when);
 
     if (toOccur == NULL)		// no pending interrupts
 	return FALSE;			
@@ -313,17 +442,16 @@ Interrupt::CheckIfDue(bool advanceClock)
     if (advanceClock && when > stats->totalTicks) {	// advance the clock
 	stats->idleTicks += (when - stats->totalTicks);
 	stats->totalTicks = when;
-    } else if (when > stats->totalTicks) {	// not time yet, put it back
-        pending->SortedInsert(toOccur, when);
+    } else if (when > stats->totalTicks)	// not time yet, leave it
         return FALSE;
-    }
 
 // Check if there is nothing more to do, and if so, quit
     if ((status == IdleMode) && (toOccur->type == TimerInt) 
-				&& pending->IsEmpty()) {
-	 pending->SortedInsert(toOccur, when);
+				&& pending->NumInHeap() == 1)
 	 return FALSE;
-    }
+    pending->RemoveMin();
+    nextDeadline = NextDeadline();
+    stats->Trace(toOccur->type, toOccur->when);
 
     DEBUG('i', "Invoking interrupt handler for the %s at time %d\n", 
 			intTypeNames[toOccur->type], toOccur->when);
@@ -338,7 +466,8 @@ Interrupt::CheckIfDue(bool advanceClock)
     (*(toOccur->handler))(toOccur->arg);	// call the interrupt handler
     status = old;				// restore the machine status
     inHandler = FALSE;
-    delete toOccur;
+    toOccur->next = freePending;		// recycle it
+    freePending = toOccur;
     return TRUE;
 }
 
@@ -67,6 +67,7 @@ class PendingInterrupt {
     int arg;                    // The argument to the function.
     int when;			// When the interrupt is supposed to fire
     IntType type;		// for debugging
+    PendingInterrupt *next;	// on the free list, once it has fired
 };
 
 // The following class defines the data structures for the simulation
@@ -112,10 +113,17 @@ class Interrupt {
     
     void OneTick();       		// Advance simulated time
 
+    int NextDeadline();			// when the next pending interrupt
+					// is due, -1 if there is none
+
   private:
     IntStatus level;		// are interrupts enabled or disabled?
-    List *pending;		// the list of interrupts scheduled
-				// to occur in the future
+    Heap *pending;		// interrupts scheduled to occur in the
+				// future, earliest first; equal times
+				// come out in the order scheduled
+    PendingInterrupt *freePending; // fired interrupts, for reuse
+    int nextDeadline;		// NextDeadline(), kept up to date so
+				// that OneTick need not look at "pending"
     bool inHandler;		// TRUE if we are running an interrupt handler
     bool yieldOnReturn; 	// TRUE if we are to context switch
 				// on return from the interrupt handler
@@ -125,6 +133,7 @@ class Interrupt {
 
     bool CheckIfDue(bool advanceClock); // Check if an interrupt is supposed
 					// to occur now
+    void MultiCpuTick();		// OneTick, with more than one CPU
 
     void ChangeLevel(IntStatus old, 	// SetLevel, without advancing the
 	IntStatus now);  		// simulated time
@@ -56,6 +56,7 @@ Machine::Machine(bool debug)
 {
     int i;
 
+    registers = spareRegisters;
     for (i = 0; i < NumTotalRegs; i++)
         registers[i] = 0;
     mainMemory = new char[MemorySize];
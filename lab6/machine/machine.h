@@ -162,7 +162,13 @@ class Machine {
     int allocatePageFrame() { return bitMap->Find(); }
     void freePageFrame(int ppn) { bitMap->Clear(ppn); }
 
-    int registers[NumTotalRegs]; // CPU registers, for executing user programs
+    int *registers;		// CPU registers, for executing user programs;
+				// points at the running thread's own
+				// register file, so a context switch
+				// swaps a pointer instead of copying
+    int spareRegisters[NumTotalRegs]; // in use while no thread's register
+				// file is attached (e.g., between
+				// InitRegisters and the first switch)
 
 
 // NOTE: the hardware translation of virtual addresses in the user program
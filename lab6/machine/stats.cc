@@ -19,9 +19,25 @@
 Statistics::Statistics()
 {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
-    numDiskReads = numDiskWrites = 0;
+    numDiskReads = numDiskWrites = diskSeekTicks = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numCacheHits = numCacheMisses = 0;
+    numReadAheadHits = numReadAheadMisses = numReadAheadSectors = 0;
+    numWritesHeld = numWriteFlushes = 0;
+    numJournalOps = numJournalCommits = numJournalBlocks = 0;
+    numJournalCheckpoints = numJournalReplayed = 0;
+    numFastLockAcquires = numSlowLockAcquires = 0;
+    numFastSemaphoreP = numSlowSemaphoreP = 0;
+    numContextSwitches = numSpaceSwitches = 0;
+    numFastTicks = traceEvents = 0;
+    traceHash = 2166136261u;
+    for (int i = 0; i < NumPolicies; i++)
+        for (int j = 0; j < LatencyBuckets; j++)
+            readyWait[i][j] = 0;
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < LatencyBuckets; j++)
+            diskQueueWait[i][j] = diskService[i][j] = 0;
 }
 
 //----------------------------------------------------------------------
@@ -35,10 +51,185 @@ Statistics::Print()
 {
     printf("Ticks: total %d, idle %d, system %d, user %d\n", totalTicks, 
 	idleTicks, systemTicks, userTicks);
-    printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
+    printf("Disk I/O: reads %d, writes %d, seek ticks %d\n", numDiskReads, 
+	numDiskWrites, diskSeekTicks);
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, 
 	numConsoleCharsWritten);
     printf("Paging: faults %d\n", numPageFaults);
+    if (numCacheHits + numCacheMisses > 0)
+	printf("Disk cache: hits %d, misses %d, hit rate %.1f%%\n",
+	    numCacheHits, numCacheMisses, 
+	    100.0 * numCacheHits / (numCacheHits + numCacheMisses));
+    if (numReadAheadHits + numReadAheadMisses > 0)
+	printf("Read-ahead: hits %d, misses %d, hit rate %.1f%%, sectors read ahead %d\n",
+	    numReadAheadHits, numReadAheadMisses, 
+	    100.0 * numReadAheadHits / (numReadAheadHits + numReadAheadMisses),
+	    numReadAheadSectors);
+    if (numWritesHeld > 0)
+	printf("Write-behind: %d writes held back, written in %d\n",
+	    numWritesHeld, numWriteFlushes);
+    if (numJournalReplayed > 0)
+	printf("Journal: replayed %d transactions\n", numJournalReplayed);
+    if (numJournalOps > 0)
+	printf("Journal: %d operations in %d commits, %d blocks logged, %d checkpoints\n",
+	    numJournalOps, numJournalCommits, numJournalBlocks, 
+	    numJournalCheckpoints);
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
+    if (numFastLockAcquires + numSlowLockAcquires 
+	    + numFastSemaphoreP + numSlowSemaphoreP > 0)
+	printf("Synch: lock acquires fast %d, slow %d; semaphore P fast %d, slow %d\n",
+	    numFastLockAcquires, numSlowLockAcquires, numFastSemaphoreP, 
+	    numSlowSemaphoreP);
+    if (numContextSwitches > 0)
+	printf("Context switches: %d, address space loads %d\n",
+	    numContextSwitches, numSpaceSwitches);
+    if (traceEvents > 0)
+	printf("Trace: %d events, checksum %08x, %d of the ticks had nothing due\n",
+	    traceEvents, traceHash, numFastTicks);
+    PrintReadyWait();
+    PrintDiskIO();
+}
+
+//----------------------------------------------------------------------
+// Statistics::Trace
+// 	Fold an event -- "what" happened, to "which" -- and the time it
+//	happened at into a running FNV-1a checksum.  Two runs of the same
+//	test that print the same checksum saw the same interrupts and ran
+//	the same threads at the same simulated times.
+//----------------------------------------------------------------------
+
+void
+Statistics::Trace(int what, int which)
+{
+    int word[3];
+
+    word[0] = totalTicks;
+    word[1] = what;
+    word[2] = which;
+    for (int i = 0; i < 3; i++)
+        for (int b = 0; b < 4; b++) {
+            traceHash ^= (word[i] >> (8 * b)) & 0xff;
+            traceHash *= 16777619u;
+        }
+    traceEvents++;
+}
+
+//----------------------------------------------------------------------
+// Statistics::RecordReadyWait
+// 	Count a thread that waited "ticks" on the run queue of 
+//	scheduling policy "policy" before it got the CPU.
+//----------------------------------------------------------------------
+
+void
+Statistics::RecordReadyWait(int policy, int ticks)
+{
+    ASSERT(policy >= 0 && policy < NumPolicies);
+    readyWait[policy][LatencyBucket(ticks)]++;
+}
+
+//----------------------------------------------------------------------
+// Statistics::PrintReadyWait
+// 	Print the run queue wait histogram of each policy that was used,
+//	one line per non-empty bucket, with a cumulative percentage.
+//----------------------------------------------------------------------
+
+void
+Statistics::PrintReadyWait()
+{
+    static const char *policyName[NumPolicies] = 
+	{ "PRIORITY", "RR", "MFQ", "STRIDE" };
+
+    for (int i = 0; i < NumPolicies; i++) {
+        int total = 0;
+
+        for (int j = 0; j < LatencyBuckets; j++)
+            total += readyWait[i][j];
+        if (total == 0)
+            continue;
+        printf("Run queue wait (%s): %d dispatches\n", policyName[i], total);
+        PrintLatencyBuckets(readyWait[i]);
+    }
+}
+
+//----------------------------------------------------------------------
+// Statistics::RecordDiskIO
+// 	Count a disk request that waited "wait" ticks in its disk's queue,
+//	and then took the disk "service" ticks.
+//----------------------------------------------------------------------
+
+void
+Statistics::RecordDiskIO(bool writing, int wait, int service)
+{
+    diskQueueWait[writing ? 1 : 0][LatencyBucket(wait)]++;
+    diskService[writing ? 1 : 0][LatencyBucket(service)]++;
+}
+
+//----------------------------------------------------------------------
+// Statistics::PrintDiskIO
+// 	Print the queue wait and service time histograms of disk reads,
+//	and of disk writes, if there were any.
+//----------------------------------------------------------------------
+
+void
+Statistics::PrintDiskIO()
+{
+    static const char *typeName[2] = { "reads", "writes" };
+
+    for (int i = 0; i < 2; i++) {
+        int total = 0;
+
+        for (int j = 0; j < LatencyBuckets; j++)
+            total += diskService[i][j];
+        if (total == 0)
+            continue;
+        printf("Disk queue wait (%s): %d requests\n", typeName[i], total);
+        PrintLatencyBuckets(diskQueueWait[i]);
+        printf("Disk service time (%s): %d requests\n", typeName[i], total);
+        PrintLatencyBuckets(diskService[i]);
+    }
+}
+
+//----------------------------------------------------------------------
+// LatencyBucket
+// 	Return which log2 bucket a time of "ticks" is counted in.
+//----------------------------------------------------------------------
+
+int
+LatencyBucket(int ticks)
+{
+    int bucket = 0;
+
+    while (ticks > 0 && bucket < LatencyBuckets - 1) {
+        bucket++;
+        ticks >>= 1;
+    }
+    return bucket;
+}
+
+//----------------------------------------------------------------------
+// PrintLatencyBuckets
+// 	Print a histogram, one line per non-empty bucket, with a 
+//	cumulative percentage.
+//----------------------------------------------------------------------
+
+void
+PrintLatencyBuckets(int *buckets)
+{
+    int total = 0, sofar = 0;
+
+    for (int j = 0; j < LatencyBuckets; j++)
+        total += buckets[j];
+    for (int j = 0; j < LatencyBuckets; j++) {
+        if (buckets[j] == 0)
+            continue;
+        sofar += buckets[j];
+        if (j == 0)
+            printf("\t%8d ticks", 0);
+        else if (j == LatencyBuckets - 1)
+            printf("\t%7d+ ticks", 1 << (j - 1));
+        else
+            printf("\t%8d ticks", 1 << (j - 1));
+        printf(" %8d %5.1f%%\n", buckets[j], 100.0 * sofar / total);
+    }
 }
@@ -19,6 +19,17 @@
 //
 // The fields in this class are public to make it easier to update.
 
+// Run queue waits, and disk request times, are kept in log2 buckets: 
+// 0 ticks, 1, 2-3, 4-7, ..., with everything from 2^(LatencyBuckets - 2)
+// on in the last bucket.
+
+#define LatencyBuckets	16
+#define NumPolicies	4	// cf. enum policy in scheduler.h
+
+extern int LatencyBucket(int ticks);	// which bucket "ticks" goes in
+extern void PrintLatencyBuckets(int *buckets);	// one line per non-empty
+					// bucket, with a running percentage
+
 class Statistics {
   public:
     int totalTicks;      	// Total time running Nachos
@@ -30,15 +41,52 @@ class Statistics {
 
     int numDiskReads;		// number of disk read requests
     int numDiskWrites;		// number of disk write requests
+    int diskSeekTicks;		// time the disk head spent seeking
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int numCacheHits;		// SynchDisk sector cache lookups that
+    int numCacheMisses;		// found the sector, and that didn't
+    int numReadAheadHits;	// sectors sequential Reads found read
+    int numReadAheadMisses;	// ahead, and ones they had to read
+    int numReadAheadSectors;	// sectors asked for ahead of time
+    int numWritesHeld;		// small appends held back in memory,
+    int numWriteFlushes;	// and the WriteAts they were written in
+    int numJournalOps;		// file system operations journaled,
+    int numJournalCommits;	// the transactions they were grouped in,
+    int numJournalBlocks;	// and the log blocks those took
+    int numJournalCheckpoints;	// times the log was emptied
+    int numJournalReplayed;	// transactions replayed when mounting
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
+    int numFastLockAcquires;	// Lock::Acquire on a FREE lock
+    int numSlowLockAcquires;	// Lock::Acquire that had to wait
+    int numFastSemaphoreP;	// Semaphore::P with value > 0
+    int numSlowSemaphoreP;	// Semaphore::P that may have to wait
+    int numContextSwitches;	// threads switched by Scheduler::Run
+    int numSpaceSwitches;	// of those, ones that had to load a
+				// different address space
+    int numFastTicks;		// OneTick calls with nothing to do
+    int traceEvents;		// interrupts fired and threads run ...
+    unsigned int traceHash;	// ... and a checksum of when, and what;
+				// equal for two runs that behaved the same
+    int readyWait[NumPolicies][LatencyBuckets];
+				// run queue wait histograms, per
+				// scheduling policy
+    int diskQueueWait[2][LatencyBuckets];
+    int diskService[2][LatencyBuckets];
+				// disk request histograms, for reads 
+				// and writes: ticks waiting in the
+				// queue, and ticks the disk took
 
     Statistics(); 		// initialize everything to zero
 
     void Print();		// print collected statistics
+    void RecordReadyWait(int policy, int ticks);
+    void PrintReadyWait();	// print the run queue wait histograms
+    void RecordDiskIO(bool writing, int wait, int service);
+    void PrintDiskIO();		// print the disk request histograms
+    void Trace(int what, int which);	// fold an event into traceHash
 };
 
 // Constants used to reflect the relative time an operation would
@@ -39,6 +39,7 @@ extern "C" {
 #ifdef HOST_i386
 #include <unistd.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <errno.h>
 #endif
 #ifdef HOST_SPARC
@@ -227,6 +228,56 @@ Lseek(int fd, int offset, int whence)
     ASSERT(retVal >= 0);
 }
 
+//----------------------------------------------------------------------
+// ReadFileAt, WriteFileAt
+// 	Read or write characters at "offset" in an open file, without
+//	a separate Lseek.  Abort if the read or write fails.
+//----------------------------------------------------------------------
+
+void
+ReadFileAt(int fd, char *buffer, int nBytes, int offset)
+{
+    int retVal = pread(fd, buffer, nBytes, offset);
+    ASSERT(retVal == nBytes);
+}
+
+void
+WriteFileAt(int fd, char *buffer, int nBytes, int offset)
+{
+    int retVal = pwrite(fd, buffer, nBytes, offset);
+    ASSERT(retVal == nBytes);
+}
+
+//----------------------------------------------------------------------
+// MapFile, SyncMappedFile, UnmapFile
+// 	Map the first "nBytes" of an open file into memory, shared, so 
+//	that changes to the memory are changes to the file; write the
+//	changes out to the file now; and unmap it again.  Abort on error.
+//----------------------------------------------------------------------
+
+char *
+MapFile(int fd, int nBytes)
+{
+    void *addr = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    ASSERT(addr != MAP_FAILED);
+    return (char *) addr;
+}
+
+void
+SyncMappedFile(char *addr, int nBytes)
+{
+    int retVal = msync(addr, nBytes, MS_SYNC);
+    ASSERT(retVal == 0);
+}
+
+void
+UnmapFile(char *addr, int nBytes)
+{
+    int retVal = munmap(addr, nBytes);
+    ASSERT(retVal == 0);
+}
+
 //----------------------------------------------------------------------
 // Tell
 // 	Report the current location within an open file.
@@ -417,6 +468,22 @@ Delay(int seconds)
     (void) sleep((unsigned) seconds);
 }
 
+//----------------------------------------------------------------------
+// HostTime
+// 	Return the host's wall clock time, in seconds.  Simulated time
+//	says nothing about how fast the simulator itself runs, so the
+//	benchmarks use this to report rates per host second.
+//----------------------------------------------------------------------
+
+double
+HostTime()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
@@ -439,6 +506,85 @@ Exit(int exitCode)
     exit(exitCode);
 }
 
+//----------------------------------------------------------------------
+// RunBatch
+// 	Run a batch of independent Nachos instances as host processes,
+//	at most "parallel" at a time, to use all of the host's cores.
+//
+//	Each line of "jobFile" holds the arguments of one instance (blank
+//	lines and lines starting with '#' are skipped).  Instance k runs
+//	on its own copy of DISK, DISK.jobk, so the instances share nothing 
+//	but the starting disk image; its output goes to "jobFile".k.out.
+//	An instance striped over n disks ("-disks n") gets copies of DISK.0
+//	to DISK.n-1 instead, as DISK.jobk.0 to DISK.jobk.n-1.  Each 
+//	instance is as deterministic as it would be on its own, whatever
+//	the interleaving on the host.
+//
+//	Returns the number of instances that failed, or could not be
+//	started.
+//----------------------------------------------------------------------
+
+int
+RunBatch(char *program, char *jobFile, int parallel)
+{
+    FILE *jobs = fopen(jobFile, "r");
+    char line[1024], args[1024], copy[256], command[3072];
+    char *arg;
+    int numJobs = 0, running = 0, failed = 0, status, disks;
+    pid_t pid;
+    time_t start = time(NULL);
+
+    ASSERT(jobs != NULL && parallel > 0);
+    while (fgets(line, sizeof(line), jobs) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        if (running == parallel) {		// wait for a free slot
+            wait(&status);
+            running--;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                failed++;
+        }
+        strcpy(args, line);			// split into argv tokens, as
+        disks = 1;				// the instance will see them
+        for (arg = strtok(args, " \t"); arg != NULL; 
+					arg = strtok(NULL, " \t"))
+            if (!strcmp(arg, "-disks") && (arg = strtok(NULL, " \t")) != NULL)
+                disks = atoi(arg);
+        if (disks <= 1)
+            sprintf(copy, "if [ -f DISK ]; then cp DISK DISK.job%d; fi", 
+                numJobs);
+        else
+            sprintf(copy, "i=0; while [ $i -lt %d ]; do "
+                "if [ -f DISK.$i ]; then cp DISK.$i DISK.job%d.$i; fi; "
+                "i=$((i + 1)); done", disks, numJobs);
+        sprintf(command, "%s; exec %s -disk DISK.job%d %s > %s.%d.out 2>&1", 
+            copy, program, numJobs, line, jobFile, numJobs);
+        pid = fork();
+        if (pid == 0) {
+            execl("/bin/sh", "sh", "-c", command, (char *) NULL);
+            _exit(127);
+        }
+        numJobs++;
+        if (pid < 0) {
+            fprintf(stderr, "Batch: can't start instance %d\n", numJobs - 1);
+            failed++;
+            continue;
+        }
+        running++;
+    }
+    fclose(jobs);
+    while (running > 0) {
+        wait(&status);
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed++;
+    }
+    printf("%d instances, %d failed, %d seconds with %d at a time\n", 
+        numJobs, failed, (int) (time(NULL) - start), parallel);
+    return failed;
+}
+
 //----------------------------------------------------------------------
 // RandomInit
 // 	Initialize the pseudo-random number generator.  We use the
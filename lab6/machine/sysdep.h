@@ -25,6 +25,14 @@ extern void Read(int fd, char *buffer, int nBytes);
 extern int ReadPartial(int fd, char *buffer, int nBytes);
 extern void WriteFile(int fd, char *buffer, int nBytes);
 extern void Lseek(int fd, int offset, int whence);
+extern void ReadFileAt(int fd, char *buffer, int nBytes, int offset);
+extern void WriteFileAt(int fd, char *buffer, int nBytes, int offset);
+					// Read/WriteFile at "offset", in
+					// one system call
+extern char *MapFile(int fd, int nBytes);	// map the first nBytes of
+						// an open file into memory
+extern void SyncMappedFile(char *addr, int nBytes);	// and write them out
+extern void UnmapFile(char *addr, int nBytes);
 extern int Tell(int fd);
 extern void Close(int fd);
 extern bool Unlink(char *name);
@@ -42,6 +50,8 @@ extern void SendToSocket(int sockID, char *buffer, int packetSize,char *toName);
 extern void Abort();
 extern void Exit(int exitCode);
 extern void Delay(int seconds);
+extern double HostTime();		// wall clock seconds, for benchmarks
+extern int RunBatch(char *program, char *jobFile, int parallel);
 
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(VoidNoArgFunctionPtr cleanUp);
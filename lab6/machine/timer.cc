@@ -39,19 +39,37 @@ static void TimerHandler(int arg)
 //      "callArg" is the parameter to be passed to the interrupt handler.
 //      "doRandom" -- if true, arrange for the interrupts to occur
 //		at random, instead of fixed, intervals.
+//      "doOneShot" -- if true, only interrupt when armed
 //----------------------------------------------------------------------
 
-Timer::Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom)
+Timer::Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom,
+		bool doOneShot)
 {
     randomize = doRandom;
     handler = timerHandler;
     arg = callArg; 
+    oneShot = doOneShot;
+    deadline = -1;
+    scheduled = new Heap();
+    numInterrupts = numStale = 0;
 
     // schedule the first interrupt from the timer device
-    interrupt->Schedule(TimerHandler, (int) this, TimeOfNextInterrupt(), 
+    if (!oneShot)
+        interrupt->Schedule(TimerHandler, (int) this, TimeOfNextInterrupt(), 
 		TimerInt); 
 }
 
+//----------------------------------------------------------------------
+// Timer::~Timer
+//      De-allocate the timer.  Any interrupt still pending for it has
+//	to be left to fire; Nachos only deletes the timer on the way out.
+//----------------------------------------------------------------------
+
+Timer::~Timer()
+{
+    delete scheduled;
+}
+
 //----------------------------------------------------------------------
 // Timer::TimerExpired
 //      Routine to simulate the interrupt generated by the hardware 
@@ -61,6 +79,19 @@ Timer::Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom)
 void 
 Timer::TimerExpired()
 {
+    numInterrupts++;
+    if (oneShot) {
+        scheduled->RemoveMin();
+        if (deadline == -1 || stats->totalTicks < deadline) {
+            numStale++;			// armed for some other time since
+            Program();
+            return;
+        }
+        deadline = -1;
+        (*handler)(arg);
+        return;
+    }
+
     // schedule the next timer device interrupt
     interrupt->Schedule(TimerHandler, (int) this, TimeOfNextInterrupt(), 
 		TimerInt);
@@ -83,3 +114,75 @@ Timer::TimeOfNextInterrupt()
     else
 	    return TimerTicks; 
 }
+
+//----------------------------------------------------------------------
+// Timer::Arm
+//      Have a one-shot timer interrupt at time "when", and not at the
+//	time it was armed for before, if any.
+//
+//	Pending interrupts can't be taken back, so one for an earlier 
+//	time is left to fire and be ignored; one for a later time is
+//	ignored too, since by then we will have been disarmed or re-armed.
+//----------------------------------------------------------------------
+
+void
+Timer::Arm(int when)
+{
+    ASSERT(oneShot);
+    if (when <= stats->totalTicks)
+        when = stats->totalTicks + 1;
+    deadline = when;
+    Program();
+}
+
+//----------------------------------------------------------------------
+// Timer::Disarm
+//      Have a one-shot timer not interrupt.
+//----------------------------------------------------------------------
+
+void
+Timer::Disarm()
+{
+    deadline = -1;
+}
+
+//----------------------------------------------------------------------
+// Timer::Program
+//      Schedule an interrupt for "deadline", unless one is already 
+//	pending for then or earlier; in that case, we look again when 
+//	that one fires.
+//----------------------------------------------------------------------
+
+void
+Timer::Program()
+{
+    int first;
+
+    if (deadline == -1)
+        return;
+    if (scheduled->Min(&first) != NULL && first <= deadline)
+        return;
+    interrupt->Schedule(TimerHandler, (int) this, 
+        deadline - stats->totalTicks, TimerInt);
+    scheduled->Insert((void *) this, deadline);
+}
+
+//----------------------------------------------------------------------
+// Timer::Print
+//      Print how many timer interrupts there were.  A one-shot timer 
+//	compares that with the one every TimerTicks a periodic timer 
+//	would have taken.
+//----------------------------------------------------------------------
+
+void
+Timer::Print()
+{
+    if (!oneShot) {
+        printf("Timer: %d interrupts, periodic\n", numInterrupts);
+        return;
+    }
+    int periodic = stats->totalTicks / TimerTicks;
+    printf("Timer: %d interrupts (%d superseded), %d avoided of %d periodic\n",
+        numInterrupts, numStale, 
+        periodic > numInterrupts ? periodic - numInterrupts : 0, periodic);
+}
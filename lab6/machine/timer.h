@@ -11,6 +11,13 @@
 //	In order to introduce some randomness into time-slicing, if "doRandom"
 //	is set, then the interrupt comes after a random number of ticks.
 //
+//	A timer can instead be one-shot: it is quiet until Arm'ed, and then
+//	interrupts once, at the time asked for.  The kernel arms it for
+//	when the running thread's quantum runs out, so that ticks in
+//	which nothing would happen cost no interrupt.  Periodic timer 
+//	interrupts still come every TimerTicks, and the one-shot timer 
+//	reports how many of those it avoided.
+//
 //  DO NOT CHANGE -- part of the machine emulation
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -22,14 +29,24 @@
 
 #include "copyright.h"
 #include "utility.h"
+#include "list.h"
 
 // The following class defines a hardware timer. 
 class Timer {
   public:
-    Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom);
+    Timer(VoidFunctionPtr timerHandler, int callArg, bool doRandom,
+	bool doOneShot = FALSE);
 				// Initialize the timer, to call the interrupt
-				// handler "timerHandler" every time slice.
-    ~Timer() {}
+				// handler "timerHandler" every time slice,
+				// or when armed
+    ~Timer();
+
+    bool IsOneShot() { return oneShot; }
+    void Arm(int when);		// one-shot: interrupt at time "when" 
+				// (or as soon after as possible), instead
+				// of when last armed for
+    void Disarm();		// one-shot: don't interrupt after all
+    void Print();		// how many interrupts, and how many saved
 
 // Internal routines to the timer emulation -- DO NOT call these
 
@@ -44,6 +61,16 @@ class Timer {
     VoidFunctionPtr handler;	// timer interrupt handler 
     int arg;			// argument to pass to interrupt handler
 
+    bool oneShot;		// interrupt only when armed
+    int deadline;		// when armed for, -1 if not armed
+    Heap *scheduled;		// times of our pending interrupts; the
+				// ones before "deadline" have been
+				// superseded, and are ignored when they fire
+    int numInterrupts;		// timer interrupts taken
+    int numStale;		// of those, superseded ones
+
+    void Program();		// make sure an interrupt is pending for
+				// "deadline"
 };
 
 #endif // TIMER_H
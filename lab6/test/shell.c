@@ -1,5 +1,35 @@
 #include "syscall.h"
 
+/* Run "left | right": point left's output and right's input at a
+ * pipe while Exec'ing them, then put the console back.
+ */
+void
+pipeline(char *left, char *right)
+{
+    OpenFileId ends[2], console;
+    SpaceId leftProc, rightProc;
+
+    console = Dup(ConsoleOutput);
+    Pipe(ends);
+
+    Close(ConsoleOutput);
+    Dup(ends[1]);
+    Close(ends[1]);
+    leftProc = Exec(left);
+    Close(ConsoleOutput);
+    Dup(console);
+
+    Close(ConsoleInput);
+    Dup(ends[0]);
+    Close(ends[0]);
+    rightProc = Exec(right);
+    Close(ConsoleInput);
+    Dup(console);
+
+    Join(leftProc);
+    Join(rightProc);
+}
+
 int
 main()
 {
@@ -7,7 +37,7 @@ main()
     OpenFileId input = ConsoleInput;
     OpenFileId output = ConsoleOutput;
     char prompt[2], ch, buffer[60];
-    int i;
+    int i, bar;
 
     prompt[0] = '-';
     prompt[1] = '-';
@@ -17,19 +47,28 @@ main()
         Write(prompt, 2, output);
 
         i = 0;
+        bar = -1;
         
         do {
         
             Read(&buffer[i], 1, input); 
+            if (buffer[i] == '|')
+                bar = i;
 
         } while( buffer[i++] != '\n' );
 
         buffer[--i] = '\0';
 
-        if( i > 0 ) {
+        if( bar >= 0 ) {
+            buffer[bar] = '\0';
+            for (i = bar - 1; i >= 0 && buffer[i] == ' '; i--)
+                buffer[i] = '\0';
+            for (i = bar + 1; buffer[i] == ' '; i++)
+                ;
+            pipeline(buffer, &buffer[i]);
+        } else if( i > 0 ) {
             newProc = Exec(buffer);
             Join(newProc);
         }
     }
 }
-
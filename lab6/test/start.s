@@ -130,6 +130,22 @@ Yield:
 	j	$31
 	.end Yield
 
+	.globl Pipe
+	.ent	Pipe
+Pipe:
+	addiu $2,$0,SC_Pipe
+	syscall
+	j	$31
+	.end Pipe
+
+	.globl Dup
+	.ent	Dup
+Dup:
+	addiu $2,$0,SC_Dup
+	syscall
+	j	$31
+	.end Dup
+
 /* dummy function to keep gcc happy */
         .globl  __main
         .ent    __main
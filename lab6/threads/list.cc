@@ -280,4 +280,169 @@ List::highestPriority()
     if (first)
         return first->key;
     return -1;
-}
\ No newline at end of file
+}
+//----------------------------------------------------------------------
+// Heap::Heap
+//	Initialize a heap, empty to start with, with room for
+//	"initialSize" items before it has to grow.
+//----------------------------------------------------------------------
+
+Heap::Heap(int initialSize)
+{
+    ASSERT(initialSize > 0);
+    size = initialSize;
+    elements = new HeapElement[size];
+    numInHeap = 0;
+    nextSeq = 0;
+}
+
+//----------------------------------------------------------------------
+// Heap::~Heap
+//	De-allocate the heap.  As with List, the items themselves are
+//	not de-allocated.
+//----------------------------------------------------------------------
+
+Heap::~Heap()
+{
+    delete [] elements;
+}
+
+//----------------------------------------------------------------------
+// Heap::Less, Heap::Swap, Heap::SiftUp, Heap::SiftDown
+//	Helpers to restore the heap property after an element moves.
+//	Ties on "key" are broken by insertion order.
+//----------------------------------------------------------------------
+
+bool
+Heap::Less(int i, int j)
+{
+    if (elements[i].key != elements[j].key)
+        return elements[i].key < elements[j].key;
+    return elements[i].seq < elements[j].seq;
+}
+
+void
+Heap::Swap(int i, int j)
+{
+    HeapElement tmp = elements[i];
+
+    elements[i] = elements[j];
+    elements[j] = tmp;
+}
+
+void
+Heap::SiftUp(int i)
+{
+    while (i > 0 && Less(i, (i - 1) / 2)) {
+        Swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+void
+Heap::SiftDown(int i)
+{
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1, right = 2 * i + 2;
+
+        if (left < numInHeap && Less(left, smallest))
+            smallest = left;
+        if (right < numInHeap && Less(right, smallest))
+            smallest = right;
+        if (smallest == i)
+            return;
+        Swap(i, smallest);
+        i = smallest;
+    }
+}
+
+//----------------------------------------------------------------------
+// Heap::Insert
+//	Put an item on the heap, doubling the array if it is full.
+//
+//	"item" is the thing to put on the heap, it can be a pointer to 
+//		anything.
+//	"key" is the key; the item with the smallest key comes out first.
+//----------------------------------------------------------------------
+
+void
+Heap::Insert(void *item, int key)
+{
+    if (numInHeap == size) {
+        HeapElement *bigger = new HeapElement[2 * size];
+
+        for (int i = 0; i < numInHeap; i++)
+            bigger[i] = elements[i];
+        delete [] elements;
+        elements = bigger;
+        size *= 2;
+    }
+    elements[numInHeap].item = item;
+    elements[numInHeap].key = key;
+    elements[numInHeap].seq = nextSeq++;
+    numInHeap++;
+    SiftUp(numInHeap - 1);
+}
+
+//----------------------------------------------------------------------
+// Heap::RemoveMin, Heap::Min
+//	Return the item with the smallest key (the earliest inserted, if
+//	several share it), or NULL if the heap is empty.  RemoveMin also
+//	takes it off the heap.
+//
+//	"keyPtr" if not NULL, is set to the item's key.
+//----------------------------------------------------------------------
+
+void *
+Heap::RemoveMin(int *keyPtr)
+{
+    void *item;
+
+    if (numInHeap == 0)
+        return NULL;
+    item = elements[0].item;
+    if (keyPtr != NULL)
+        *keyPtr = elements[0].key;
+    numInHeap--;
+    if (numInHeap > 0) {
+        elements[0] = elements[numInHeap];
+        SiftDown(0);
+    }
+    return item;
+}
+
+void *
+Heap::Min(int *keyPtr)
+{
+    if (numInHeap == 0)
+        return NULL;
+    if (keyPtr != NULL)
+        *keyPtr = elements[0].key;
+    return elements[0].item;
+}
+
+//----------------------------------------------------------------------
+// Heap::Shift
+//	Add "delta" to every key.  The order of the items does not change,
+//	so the heap stays valid.
+//----------------------------------------------------------------------
+
+void
+Heap::Shift(int delta)
+{
+    for (int i = 0; i < numInHeap; i++)
+        elements[i].key += delta;
+}
+
+//----------------------------------------------------------------------
+// Heap::Mapcar
+//	Apply a function to each item on the heap, in array order.
+//----------------------------------------------------------------------
+
+void
+Heap::Mapcar(VoidFunctionPtr func)
+{
+    for (int i = 0; i < numInHeap; i++)
+        (*func)((int)elements[i].item);
+}
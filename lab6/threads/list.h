@@ -70,4 +70,48 @@ class List {
     int numInList;		// number of elements in list
 };
 
+// The following class defines a "heap" -- a binary min-heap of
+// (item, key) pairs, for callers that need the smallest key in
+// O(log n) rather than the O(n) of SortedInsert.  Items with equal keys
+// come out in the order they went in.
+//
+// The elements live in one array, grown by doubling, so Insert and
+// RemoveMin do not allocate in the common case.
+
+class HeapElement {
+  public:
+    void *item;			// pointer to item on the heap
+    int key;			// smallest key comes out first
+    unsigned int seq;		// insertion order, to break ties
+};
+
+class Heap {
+  public:
+    Heap(int initialSize = 16);	// initialize the heap
+    ~Heap();			// de-allocate the heap
+
+    void Insert(void *item, int key);	// put item into heap
+    void *RemoveMin(int *keyPtr = NULL);	// remove item with smallest
+					// key, NULL if heap is empty
+    void *Min(int *keyPtr = NULL);	// like RemoveMin, but leave the 
+					// item on the heap
+
+    void Shift(int delta);	// add "delta" to every key
+    void Mapcar(VoidFunctionPtr func);	// apply "func" to every item,
+					// in no particular order
+    bool IsEmpty() { return numInHeap == 0; }
+    int NumInHeap() { return numInHeap; }
+
+  private:
+    HeapElement *elements;	// elements[0] has the smallest key
+    int size;			// capacity of "elements"
+    int numInHeap;
+    unsigned int nextSeq;
+
+    bool Less(int i, int j);	// does element i come out before j?
+    void Swap(int i, int j);
+    void SiftUp(int i);
+    void SiftDown(int i);
+};
+
 #endif // LIST_H
@@ -8,7 +8,9 @@
 //
 // 	Most of this file is not needed until later assignments.
 //
-// Usage: nachos -d <debugflags> -rs <random seed #>
+// Usage: nachos -j <n> <job file>
+//	 nachos -d <debugflags> -rs <random seed #> -npi -ncpu <n> -ps
+//		-slowtick -tc -periodic
 //		-s -x <nachos file> -c <consoleIn> <consoleOut>
 //		-f -cp <unix file> <nachos file>
 //		-p <nachos file> -r <nachos file> -l -D -t
@@ -18,7 +20,16 @@
 //
 //    -d causes certain debugging messages to be printed (cf. utility.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
+//    -npi turns off priority inheritance in Lock
+//    -ps prints where each thread's time went, as it exits and at halt
+//    -ncpu simulates that many CPUs (PRIORITY or RR only)
+//    -slowtick makes every tick look for due interrupts and preemption,
+//	as it used to; the "Trace" checksum printed at halt should not change
+//    -tc checks, on each tick that skips that work, that it was right to
+//    -periodic has the timer interrupt every TimerTicks, rather than
+//	only when the running thread's quantum is up
 //    -z prints the copyright message
+//    -j runs each line of the job file as a separate Nachos, n at once
 //
 //  USER_PROGRAM
 //    -s causes user programs to be executed in single-step mode
@@ -26,6 +37,20 @@
 //    -c tests the console
 //
 //  FILESYS
+//    -disk names the UNIX file holding the disk (default "DISK")
+//    -nc turns off the sector cache, so every read and write goes to disk
+//    -nra turns off read-ahead for files read sequentially
+//    -nwb turns off holding back small appends to a file
+//    -nj turns off the metadata journal (a journal left on the disk is
+//	still replayed)
+//    -mmap maps the UNIX file holding the disk into memory
+//    -msync has a mapped disk file written out after every n writes
+//	(default: only at the end)
+//    -dg gives the sectors per track and the tracks of a new disk 
+//	(default 32 and 32); an existing disk keeps its own
+//    -disks stripes the disk across n UNIX files (DISK.0, DISK.1, ...)
+//    -iotrace writes a record of every disk request to a UNIX file
+//    -iosum summarizes such a file
 //    -f causes the physical disk to be formatted
 //    -cp copies a file from UNIX to Nachos
 //    -p prints a Nachos file to stdout
@@ -33,6 +58,13 @@
 //    -l lists the contents of the Nachos directory
 //    -D prints the contents of the entire file system 
 //    -t tests the performance of the Nachos file system
+//    -rw stresses one file with concurrent readers and writers
+//    -dq compares the disk scheduling policies on random reads
+//    -st times reads from volumes striped across 1, 2, 4 and 8 disks
+//    -jt times concurrent creates and removes, and counts their commits
+//	(after "-dg 32 4096 -f", on a 16MB disk)
+//    -dp sets the disk scheduling policy (0 FCFS, 1 SSTF, 2 SCAN, 
+//	3 C-LOOK, the default)
 //
 //  NETWORK
 //    -n sets the network reliability
@@ -61,7 +93,8 @@ extern int testnum;
 
 extern void ThreadTest(void), Copy(char *unixFile, char *nachosFile);
 extern void Print(char *file), PerformanceTest(void);
-extern void SynchTest(), PipeTest();
+extern void SynchTest(), PipeTest(), ReaderWriterTest(), DiskQueueTest();
+extern void StripeTest(), IOTraceSummary(char *name), JournalTest();
 extern void StartProcess(char *file), ConsoleTest(char *in, char *out);
 extern void StartMultiProcess(int n, char **fileNames), ConsoleTest(char *in, char *out);
 extern void MailTest(int networkID);
@@ -87,6 +120,8 @@ main(int argc, char **argv)
 					// for a particular command
 
     DEBUG('t', "Entering main");
+    if (argc == 4 && !strcmp(argv[1], "-j"))	// batch of instances
+        return RunBatch(argv[0], argv[3], atoi(argv[2]));
     (void) Initialize(argc, argv);
     
 #ifdef THREADS
@@ -167,6 +202,22 @@ main(int argc, char **argv)
         } else if (!strcmp(*argv, "-pp")) {
             PipeTest();
             argCount = 1;
+        } else if (!strcmp(*argv, "-rw")) {
+            ReaderWriterTest();
+            argCount = 1;
+        } else if (!strcmp(*argv, "-dq")) {
+            DiskQueueTest();
+            argCount = 1;
+        } else if (!strcmp(*argv, "-st")) {
+            StripeTest();
+            argCount = 1;
+        } else if (!strcmp(*argv, "-jt")) {
+            JournalTest();
+            argCount = 1;
+        } else if (!strcmp(*argv, "-iosum")) {
+	    ASSERT(argc > 1);
+            IOTraceSummary(*(argv + 1));
+            argCount = 2;
         }
 #endif // FILESYS
 #ifdef NETWORK
@@ -22,14 +22,60 @@
 #include "scheduler.h"
 #include "system.h"
 
+//----------------------------------------------------------------------
+// Cpu::Cpu
+// 	Initialize a simulated CPU, idle and with an empty run queue.
+//----------------------------------------------------------------------
+
+Cpu::Cpu(int cpuId)
+{
+    id = cpuId;
+    current = NULL;
+    readyList = new List;
+    clock = 0;
+    preempt = FALSE;
+    busyTicks = idleTicks = steals = 0;
+}
+
+Cpu::~Cpu()
+{
+    delete readyList;
+}
+
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
 // 	Initialize the list of ready but not running threads to empty.
+//
+//	"ncpus" is the number of simulated CPUs.  Only PRIORITY and RR 
+//	can run on more than one.
 //----------------------------------------------------------------------
 
-Scheduler::Scheduler(policy _policy) : schedulerPolicy(_policy)
+Scheduler::Scheduler(policy _policy, int ncpus) : schedulerPolicy(_policy)
 { 
-    readyList = new List; 
+    ASSERT(ncpus >= 1 && ncpus <= MaxCpus);
+    ASSERT(ncpus == 1 || schedulerPolicy == PRIORITY || schedulerPolicy == RR);
+    numCpus = ncpus;
+    for (int i = 0; i < numCpus; i++)
+        cpus[i] = new Cpu(i);
+    cpu = cpus[0];
+    readyList = cpu->readyList; 
+    for (int i = 0; i < MFQLevels; i++)
+        levelQueues[i] = new List;
+    lastBoost = 0;
+    preemptKnown = FALSE;
+    chargedPeriods = 0;
+    userHeap = NULL;
+    runningUser = NULL;
+    globalPass = 0;
+    if (schedulerPolicy == STRIDE) {
+        userHeap = new Heap;
+        for (int i = 0; i < MAX_USERS; i++) {
+            users[i].tickets = DEFAULT_TICKETS;
+            users[i].pass = users[i].lastPass = 0;
+            users[i].queued = FALSE;
+            users[i].threads = new Heap;
+        }
+    }
 }
 
 //----------------------------------------------------------------------
@@ -39,7 +85,15 @@ Scheduler::Scheduler(policy _policy) : schedulerPolicy(_policy)
 
 Scheduler::~Scheduler()
 { 
-    delete readyList; 
+    for (int i = 0; i < numCpus; i++)
+        delete cpus[i];
+    for (int i = 0; i < MFQLevels; i++)
+        delete levelQueues[i];
+    if (schedulerPolicy == STRIDE) {
+        for (int i = 0; i < MAX_USERS; i++)
+            delete users[i].threads;
+        delete userHeap;
+    }
 } 
 
 //----------------------------------------------------------------------
@@ -48,23 +102,40 @@ Scheduler::~Scheduler()
 //	Put it on the ready list, for later scheduling onto the CPU.
 //
 //	"thread" is the thread to be put on the ready list.
+//
+//	Under MFQ, a new thread starts at the level of its priority, and
+//	a thread waking up from any kind of blocking moves one level up.
+//	A thread that merely yields keeps its level and the ticks it has
+//	used at that level, so it cannot dodge demotion by yielding just
+//	before its quantum runs out.
 //----------------------------------------------------------------------
 
 void
 Scheduler::ReadyToRun (Thread *thread)
 {
+    Changed();
+    ThreadStatus oldStatus = thread->getStatus();
+
     DEBUG('t', "Putting thread %s on ready list.\n", thread->getName());
 
     thread->setStatus(READY);
+    thread->setCpu(cpu->id);
     switch (schedulerPolicy)
     {
         case MFQ:
-            thread->clearTicks();
+            if (oldStatus == JUST_CREATED)
+                thread->setLevel(LevelOf(thread->getPri()));
+            else if (oldStatus == BLOCKED && thread->getLevel() > 0)
+                thread->setLevel(thread->getLevel() - 1);
+            levelQueues[thread->getLevel()]->Append((void *)thread); break;
         case PRIORITY:  
             readyList->SortedInsert((void *)thread, thread->getPri()); break;
         case RR:
             thread->clearTicks(); readyList->Append((void *)thread); break;
+        case STRIDE:
+            thread->clearTicks(); StrideReady(thread); break;
     }
+    SetTimer();			// somebody to share the CPU with now
 }
 
 //----------------------------------------------------------------------
@@ -78,9 +149,23 @@ Scheduler::ReadyToRun (Thread *thread)
 Thread *
 Scheduler::FindNextToRun ()
 {
+    Changed();
+    int level;
+
+    if (numCpus > 1 && readyList->IsEmpty())
+        Steal(cpu);
     switch (schedulerPolicy)
     {
         case MFQ:
+            for (level = 0; level < MFQLevels; level++)
+                if (!levelQueues[level]->IsEmpty())
+                    break;
+            if (level == MFQLevels)
+                return NULL;
+            if (currentThread->getStatus() == RUNNING 
+                    && level > currentThread->getLevel())
+                return NULL;		// nobody at our level or above
+            return (Thread *)levelQueues[level]->Remove();
         case PRIORITY:  
             if (readyList->highestPriority() >= currentThread->getPri() || currentThread->getStatus() != RUNNING) 
                 return (Thread *)readyList->Remove();
@@ -88,6 +173,8 @@ Scheduler::FindNextToRun ()
                 return NULL;
         case RR:
             return (Thread *)readyList->Remove();
+        case STRIDE:
+            return StrideNext();
     }
 }
 
@@ -108,20 +195,30 @@ Scheduler::FindNextToRun ()
 void
 Scheduler::Run (Thread *nextThread)
 {
+    Changed();
     Thread *oldThread = currentThread;
     
 #ifdef USER_PROGRAM			// ignore until running user programs 
-    if (currentThread->space != NULL) {	// if this thread is a user program,
+    if (currentThread->space != NULL)	// if this thread is a user program,
         currentThread->SaveUserState(); // save the user's CPU registers
-	    currentThread->space->SaveState();
-    }
+					// (the TLB is left alone, in case
+					// the next thread shares the space)
 #endif
     
     oldThread->CheckOverflow();		    // check if the old thread
 					    // had an undetected stack overflow
 
     currentThread = nextThread;		    // switch to the next thread
+    stats->numContextSwitches++;
+    stats->Trace(-1, nextThread->getTid());	// -1: not an interrupt
+    cpu->current = nextThread;
+    if (numCpus > 1 && cpu->clock < stats->totalTicks) {
+        cpu->idleTicks += stats->totalTicks - cpu->clock;	// we were idle
+        cpu->clock = stats->totalTicks;
+    }
     currentThread->setStatus(RUNNING);      // nextThread is now running
+    chargedPeriods = stats->totalTicks / TimerTicks;
+    SetTimer();
     
     DEBUG('t', "Switching from thread \"%s\" to thread \"%s\"\n",
 	  oldThread->getName(), nextThread->getName());
@@ -147,7 +244,7 @@ Scheduler::Run (Thread *nextThread)
 #ifdef USER_PROGRAM
     if (currentThread->space != NULL) {		// if there is an address space
         currentThread->RestoreUserState();     // to restore, do it.
-	    currentThread->space->RestoreState();
+	    currentThread->space->RestoreState();	// cheap if already loaded
     }
 #endif
 }
@@ -161,23 +258,598 @@ void
 Scheduler::Print()
 {
     printf("Ready list contents:\n");
-    readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
+    if (schedulerPolicy == MFQ) {
+        for (int i = 0; i < MFQLevels; i++) {
+            printf("\n  level %d: ", i);
+            levelQueues[i]->Mapcar((VoidFunctionPtr) ThreadPrint);
+        }
+        return;
+    }
+    if (schedulerPolicy != STRIDE) {
+        readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
+        return;
+    }
+    for (int i = 0; i < MAX_USERS; i++)
+        if (!users[i].threads->IsEmpty()) {
+            printf("\n  user %d (tickets %d, pass %d): ", i, 
+                users[i].tickets, users[i].pass);
+            users[i].threads->Mapcar((VoidFunctionPtr) ThreadPrint);
+        }
 }
 
 bool 
 Scheduler::higherPriorityInList()
 {
-    return (schedulerPolicy == PRIORITY || schedulerPolicy == MFQ) && readyList->highestPriority() > currentThread->getPri();
+    if (schedulerPolicy == MFQ) {
+        for (int i = 0; i < currentThread->getLevel(); i++)
+            if (!levelQueues[i]->IsEmpty())
+                return TRUE;
+        return FALSE;
+    }
+    return schedulerPolicy == PRIORITY && readyList->highestPriority() > currentThread->getPri();
 }
 
-void 
-Scheduler::changePriority(Thread* thread, int pri)
+//----------------------------------------------------------------------
+// Scheduler::PreemptionNeeded
+// 	Same answer as higherPriorityInList, which OneTick asks after 
+//	every tick.  Worked out again only when a queue has changed, or
+//	the running thread or its priority or level has.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::PreemptionNeeded()
 {
-    if (schedulerPolicy != MFQ) 
+    if (!preemptKnown || preemptThread != currentThread 
+            || preemptPri != currentThread->getPri()
+            || preemptLevel != currentThread->getLevel()) {
+        preemptCached = higherPriorityInList();
+        preemptThread = currentThread;
+        preemptPri = currentThread->getPri();
+        preemptLevel = currentThread->getLevel();
+        preemptKnown = TRUE;
+    }
+    return preemptCached;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::QuantumExpired
+// 	Called from the timer interrupt handler, after "thread" has been
+//	charged the tick.  Return TRUE if it should give up the CPU.
+//
+//	STRIDE preempts on every tick.  MFQ demotes a thread that has used
+//	up the quantum of its level, and every MFQBoostTicks moves
+//	everybody back to the top.  The others preempt once the thread's
+//	time slice is used up.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::QuantumExpired(Thread *thread)
+{
+    switch (schedulerPolicy)
+    {
+        case STRIDE:
+            return TRUE;
+        case MFQ:
+            if (stats->totalTicks - lastBoost >= MFQBoostTicks) {
+                Boost();
+                return TRUE;
+            }
+            if (thread->getTicks() < (1 << thread->getLevel()))
+                return FALSE;
+            if (thread->getLevel() < MFQLevels - 1) {
+                DEBUG('t', "Demoting thread %s to level %d\n", 
+                    thread->getName(), thread->getLevel() + 1);
+                thread->setLevel(thread->getLevel() + 1);
+            } else
+                thread->clearTicks();
+            return TRUE;
+        default:
+            return thread->checkRunningTime();
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ChargePeriods
+// 	With a one-shot timer there is no interrupt every TimerTicks to
+//	charge the running thread a tick of its quantum.  Instead, charge
+//	it for every multiple of TimerTicks the clock has passed since it
+//	was last charged (or started running).
+//----------------------------------------------------------------------
+
+void
+Scheduler::ChargePeriods()
+{
+    int now = stats->totalTicks / TimerTicks;
+
+    if (timer == NULL || !timer->IsOneShot())
+        return;
+    for (; chargedPeriods < now; chargedPeriods++)
+        currentThread->addTicks();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::SetTimer
+// 	Arm a one-shot timer for the first multiple of TimerTicks at 
+//	which QuantumExpired will say the running thread should go: when
+//	its time slice, or its MFQ level's quantum, is used up, or when
+//	MFQ next boosts.  STRIDE preempts on every tick.
+//
+//	Under PRIORITY and RR, a thread that is alone on the CPU just
+//	starts a new slice when its slice is up, so we don't interrupt
+//	it at all; ReadyToRun calls us again once there is someone else.
+//	Nor is there anything to interrupt when nothing is running.
+//----------------------------------------------------------------------
+
+void
+Scheduler::SetTimer()
+{
+    int left;
+
+    if (timer == NULL || !timer->IsOneShot())
+        return;
+    if (currentThread == NULL || currentThread->getStatus() != RUNNING) {
+        timer->Disarm();
         return;
+    }
+    ChargePeriods();
+    switch (schedulerPolicy) {
+        case STRIDE:
+            left = 1;
+            break;
+        case MFQ: {
+            int boost = (lastBoost + MFQBoostTicks + TimerTicks - 1) / TimerTicks;
+
+            left = (1 << currentThread->getLevel()) - currentThread->getTicks();
+            if (boost - chargedPeriods < left)
+                left = boost - chargedPeriods;
+            break;
+        }
+        default:
+            if (readyList->IsEmpty()) {
+                currentThread->setTicks(currentThread->getTicks() 
+                    % currentThread->getTimeSlice());
+                timer->Disarm();
+                return;
+            }
+            left = currentThread->getTimeSlice() - currentThread->getTicks();
+            break;
+    }
+    if (left < 1)
+        left = 1;
+    timer->Arm((chargedPeriods + left) * TimerTicks);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Boost
+// 	Move every MFQ thread, ready or running, back to level 0, keeping
+//	their order.  Blocked threads go to level 0 too, so one starved
+//	before it blocked starts at the top when it wakes.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Boost()
+{
+    Changed();
+    Thread *thread;
+
+    DEBUG('t', "Boosting all threads to level 0\n");
+    for (int i = 1; i < MFQLevels; i++)
+        while ((thread = (Thread *)levelQueues[i]->Remove()) != NULL) {
+            thread->setLevel(0);
+            levelQueues[0]->Append((void *)thread);
+        }
+    for (int i = 0; i < threadTable->NumSlots(); i++) {
+        thread = threadTable->InSlot(i);
+        if (thread != NULL)
+            thread->setLevel(0);
+    }
+    lastBoost = stats->totalTicks;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::LevelOf
+// 	The MFQ level a thread of priority "pri" starts at; MAX_PRIORITY
+//	maps to level 0.
+//----------------------------------------------------------------------
+
+int
+Scheduler::LevelOf(int pri)
+{
+    return (MAX_PRIORITY - pri) * MFQLevels / (MAX_PRIORITY + 1);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::changePriority
+// 	Change the priority of "thread".  A normal change is only honoured
+//	by MFQ, where it also recomputes the time slice and moves the
+//	thread to the level of its new priority.
+//
+//	An "inherited" change comes from priority inheritance in Lock: 
+//	only the effective priority moves, and if the thread is sitting
+//	on the ready list it is re-inserted at its new position.  Only
+//	PRIORITY orders threads by priority, so the other policies have
+//	nothing to do.
+//
+//	Assumes interrupts are disabled.
+//----------------------------------------------------------------------
+
+void 
+Scheduler::changePriority(Thread* thread, int pri, bool inherited)
+{
+    Changed();
     if (pri < 0)
         return;
 
+    if (inherited) {
+        if (schedulerPolicy != PRIORITY)
+            return;
+        DEBUG('t', "Thread %s inherits priority %d\n", thread->getName(), pri);
+        if (thread->getStatus() == READY) {
+            List *queue = cpus[thread->getCpu()]->readyList;
+
+            queue->Remove((void *)thread);
+            thread->inheritPri(pri);
+            queue->SortedInsert((void *)thread, pri);
+        } else
+            thread->inheritPri(pri);
+        return;
+    }
+
+    if (schedulerPolicy != MFQ) 
+        return;
+
     thread->setPri(pri);
     thread->updateTimeSlice();
-}
\ No newline at end of file
+    if (thread->getStatus() == READY) {
+        levelQueues[thread->getLevel()]->Remove((void *)thread);
+        thread->setLevel(LevelOf(pri));
+        levelQueues[thread->getLevel()]->Append((void *)thread);
+    } else
+        thread->setLevel(LevelOf(pri));
+    if (thread == currentThread)
+        SetTimer();			// new level, new quantum
+}
+
+//----------------------------------------------------------------------
+// Scheduler::setUserTickets
+// 	Give user "userID" a share of "tickets" of the CPU, to be split
+//	among its threads by their own tickets.  Only used by STRIDE; 
+//	takes effect from the user's next dispatch.
+//----------------------------------------------------------------------
+
+void
+Scheduler::setUserTickets(int userID, int tickets)
+{
+    ASSERT(schedulerPolicy == STRIDE);
+    ASSERT(userID >= 0 && userID < MAX_USERS && tickets > 0);
+    users[userID].tickets = tickets;
+}
+
+StrideUser *
+Scheduler::UserOf(Thread *thread)
+{
+    int userID = thread->getUsrID();
+
+    ASSERT(userID >= 0 && userID < MAX_USERS);
+    return &users[userID];
+}
+
+//----------------------------------------------------------------------
+// Scheduler::StrideReady
+// 	Put "thread" on its user's heap, and the user on the user heap
+//	unless one of its threads is running.
+//
+//	A thread (or user) coming back after blocking gets no credit for
+//	the time it was away: its pass is pulled up to where its siblings
+//	(or the other users) have got to, so it cannot monopolize the CPU
+//	to catch up.
+//----------------------------------------------------------------------
+
+void
+Scheduler::StrideReady(Thread *thread)
+{
+    StrideUser *user = UserOf(thread);
+
+    if (runningUser == NULL && currentThread->getStatus() == RUNNING)
+        runningUser = UserOf(currentThread);	// the main thread, which
+						// was never dispatched
+    if (thread != currentThread) {
+        if (thread->getPass() < user->lastPass)
+            thread->setPass(user->lastPass);
+        if (user != runningUser && !user->queued && user->pass < globalPass)
+            user->pass = globalPass;
+    }
+    user->threads->Insert((void *)thread, thread->getPass());
+    if (user != runningUser && !user->queued) {
+        userHeap->Insert((void *)user, user->pass);
+        user->queued = TRUE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::StrideNext
+// 	Pick the thread with the smallest pass, of the user with the 
+//	smallest pass.  If the current thread is yielding and is still
+//	first in line, return NULL so it keeps the CPU (for another 
+//	quantum).
+//----------------------------------------------------------------------
+
+Thread *
+Scheduler::StrideNext()
+{
+    StrideUser *user;
+    Thread *next;
+    int minPass;
+
+    if (runningUser == NULL && currentThread->getStatus() == RUNNING)
+        runningUser = UserOf(currentThread);
+
+    if (currentThread->getStatus() == RUNNING) {
+        if (userHeap->Min(&minPass) == NULL || minPass > runningUser->pass) {
+            user = runningUser;			// our user is still first
+            if (user->threads->Min(&minPass) == NULL 
+                    || minPass > currentThread->getPass()) {
+                StrideDispatch(currentThread, user);
+                return NULL;
+            }
+            next = (Thread *)user->threads->RemoveMin();
+            StrideDispatch(next, user);
+            return next;
+        }
+    } else if (runningUser != NULL) {		// blocked or finished
+        if (!runningUser->threads->IsEmpty()) {
+            userHeap->Insert((void *)runningUser, runningUser->pass);
+            runningUser->queued = TRUE;
+        }
+        runningUser = NULL;
+    }
+
+    user = (StrideUser *)userHeap->RemoveMin();
+    if (user == NULL)
+        return NULL;
+    user->queued = FALSE;
+    next = (Thread *)user->threads->RemoveMin();
+    StrideDispatch(next, user);
+    return next;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::StrideDispatch
+// 	Charge "thread" and "user" one quantum for the CPU they are about
+//	to get.  A thread that gives the CPU up early forfeits the rest
+//	of its quantum.
+//----------------------------------------------------------------------
+
+void
+Scheduler::StrideDispatch(Thread *thread, StrideUser *user)
+{
+    globalPass = user->pass;
+    user->lastPass = thread->getPass();
+    user->pass += StrideOne / user->tickets;
+    thread->setPass(thread->getPass() + StrideOne / thread->getTickets());
+    runningUser = user;
+    if (user->pass > StrideRebaseAt)
+        RebaseUserPasses();
+    if (thread->getPass() > StrideRebaseAt)
+        RebaseThreadPasses(user, thread);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::RebaseUserPasses
+// 	Passes only grow; before a user's overflows, subtract the global
+//	pass -- the smallest pass of any competing user -- from all of 
+//	them.  Only differences between passes matter, so nothing changes
+//	order.  Users that are not competing may fall below 0; they are 
+//	clamped there, since they will be pulled up when they come back 
+//	anyway.
+//----------------------------------------------------------------------
+
+void
+Scheduler::RebaseUserPasses()
+{
+    int delta = globalPass;
+
+    DEBUG('t', "Rebasing stride user passes by %d\n", delta);
+    for (int i = 0; i < MAX_USERS; i++) {
+        StrideUser *user = &users[i];
+
+        user->pass -= delta;
+        if (user != runningUser && !user->queued && user->pass < 0)
+            user->pass = 0;
+    }
+    userHeap->Shift(-delta);
+    globalPass = 0;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::RebaseThreadPasses
+// 	Likewise for the threads of "user", before one of their passes
+//	overflows: subtract the pass "running" was just dispatched at,
+//	which is the smallest of any of them that is competing.  Threads
+//	of other users are on scales of their own, and are left alone.
+//----------------------------------------------------------------------
+
+void
+Scheduler::RebaseThreadPasses(StrideUser *user, Thread *running)
+{
+    int delta = user->lastPass;
+
+    DEBUG('t', "Rebasing stride thread passes of a user by %d\n", delta);
+    user->lastPass = 0;
+    user->threads->Shift(-delta);
+    for (int i = 0; i < threadTable->NumSlots(); i++) {
+        Thread *thread = threadTable->InSlot(i);
+
+        if (thread == NULL || UserOf(thread) != user)
+            continue;
+        thread->setPass(thread->getPass() - delta);
+        if (thread->getStatus() != READY && thread != running
+                && thread != currentThread && thread->getPass() < 0)
+            thread->setPass(0);
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Steal
+// 	Move the first thread on the longest run queue of any other CPU
+//	onto the run queue of "thief".  Return FALSE if there was nothing
+//	to take.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::Steal(Cpu *thief)
+{
+    Changed();
+    Cpu *victim = NULL;
+    Thread *thread;
+
+    for (int i = 0; i < numCpus; i++)
+        if (cpus[i] != thief && !cpus[i]->readyList->IsEmpty() && (victim == NULL 
+                || cpus[i]->readyList->NumInList() > victim->readyList->NumInList()))
+            victim = cpus[i];
+    if (victim == NULL)
+        return FALSE;
+
+    thread = (Thread *)victim->readyList->Remove();
+    DEBUG('t', "CPU %d steals thread %s from CPU %d\n", thief->id,
+        thread->getName(), victim->id);
+    thread->setCpu(thief->id);
+    if (schedulerPolicy == PRIORITY)
+        thief->readyList->SortedInsert((void *)thread, thread->getPri());
+    else
+        thief->readyList->Append((void *)thread);
+    thief->steals++;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::EarliestCpu
+// 	Return the busy CPU with the smallest clock, the lowest numbered
+//	one if there is a tie; NULL if all CPUs are idle.
+//----------------------------------------------------------------------
+
+Cpu *
+Scheduler::EarliestCpu()
+{
+    Cpu *earliest = NULL;
+
+    for (int i = 0; i < numCpus; i++)
+        if (cpus[i]->current != NULL 
+                && (earliest == NULL || cpus[i]->clock < earliest->clock))
+            earliest = cpus[i];
+    return earliest;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::StartIdleCpus
+// 	Give every idle CPU the first thread on its run queue, or one
+//	stolen from another CPU.  Its clock jumps to the current time; 
+//	the gap is counted as idle.  The thread starts executing when
+//	Interrupt::OneTick next picks that CPU.
+//----------------------------------------------------------------------
+
+void
+Scheduler::StartIdleCpus()
+{
+    Changed();
+    for (int i = 0; i < numCpus; i++) {
+        Cpu *idle = cpus[i];
+        Thread *thread;
+
+        if (idle->current != NULL)
+            continue;
+        if (idle->readyList->IsEmpty() && !Steal(idle))
+            continue;
+        thread = (Thread *)idle->readyList->Remove();
+        thread->setStatus(RUNNING);
+        idle->current = thread;
+        if (idle->clock < stats->totalTicks) {
+            idle->idleTicks += stats->totalTicks - idle->clock;
+            idle->clock = stats->totalTicks;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::SwitchCpu
+// 	Stop executing the current CPU and start executing "to", by 
+//	switching to the thread running there.  The current thread
+//	stays RUNNING on its CPU, and this returns when some CPU switch 
+//	(or, if it blocks meanwhile, some dispatch) gets back to it.
+//
+//	Assumes interrupts are disabled.
+//----------------------------------------------------------------------
+
+void
+Scheduler::SwitchCpu(Cpu *to)
+{
+    Changed();
+    ASSERT(to->current != NULL);
+    DEBUG('t', "Switching from CPU %d to CPU %d\n", cpu->id, to->id);
+    cpu = to;
+    readyList = to->readyList;
+    Run(to->current);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::IdleCpu
+// 	Called from Thread::Sleep when the current CPU has nothing else
+//	to run.  The CPU goes idle and another busy CPU takes over the 
+//	host.  Return TRUE once the sleeping thread has been woken up and
+//	dispatched again; FALSE if every CPU is idle, in which case the 
+//	caller should wait for an interrupt.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::IdleCpu()
+{
+    Cpu *to;
+
+    if (numCpus == 1)
+        return FALSE;
+    cpu->current = NULL;
+    if ((to = EarliestCpu()) == NULL)
+        return FALSE;
+    SwitchCpu(to);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::TimerTickCpus
+// 	The timer interrupt, with more than one CPU: charge the tick to the
+//	thread on each busy CPU, and mark the ones whose time is up so
+//	that they yield the next time they execute.
+//----------------------------------------------------------------------
+
+void
+Scheduler::TimerTickCpus()
+{
+    for (int i = 0; i < numCpus; i++) {
+        Thread *thread = cpus[i]->current;
+
+        if (thread == NULL)
+            continue;
+        thread->addTicks();
+        if (QuantumExpired(thread))
+            cpus[i]->preempt = TRUE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::PrintCpus
+// 	Print how busy each CPU was, and how much work it stole.
+//----------------------------------------------------------------------
+
+void
+Scheduler::PrintCpus()
+{
+    for (int i = 0; i < numCpus; i++) {
+        Cpu *c = cpus[i];
+        int idle = c->idleTicks;
+
+        if (c->current == NULL && c->clock < stats->totalTicks)
+            idle += stats->totalTicks - c->clock;
+        printf("CPU %d: busy ticks %d, idle ticks %d, steals %d\n", 
+            c->id, c->busyTicks, idle, c->steals);
+    }
+}
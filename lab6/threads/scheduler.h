@@ -13,7 +13,72 @@
 #include "list.h"
 #include "thread.h"
 
-enum policy {PRIORITY, RR, MFQ};
+enum policy {PRIORITY, RR, MFQ, STRIDE};
+
+// Multi-level feedback queue (MFQ): MFQLevels FIFO queues, level 0
+// first.  A thread at level l may run 2^l timer ticks before it is
+// preempted and moved one level down; a thread that blocks moves one
+// level up.  Every MFQBoostTicks all threads go back to level 0, so
+// nothing at the bottom starves.  A thread's initial level comes from
+// its priority.
+
+#define MFQLevels 4
+#define MFQBoostTicks 5000
+
+// Stride scheduling (STRIDE) hands out CPU time in proportion to
+// tickets, at two levels: each user gets a share of the CPU according
+// to its tickets, and each of the user's threads a share of that
+// according to the thread's tickets.  Every time a thread is
+// dispatched, it and its user are charged one quantum (a timer tick) by
+// advancing their "pass" by StrideOne / tickets; the user with the
+// smallest pass runs next, and within it the thread with the smallest
+// pass.  Both choices come off a Heap, so a decision is O(log n).
+// User passes and each user's thread passes are separate scales; 
+// whichever one gets past StrideRebaseAt is pulled back on its own.
+
+#define MAX_USERS 32			// userIDs must be below this
+#define StrideOne (1 << 20)		// pass advance for a single ticket
+#define StrideRebaseAt (1 << 30)	// pull passes back to 0 past this
+
+class StrideUser {
+  public:
+    int tickets;			// share of the whole CPU
+    int pass;				// key in the scheduler's user heap
+    int lastPass;			// pass of our last dispatched thread
+    bool queued;			// are we in the user heap?
+    Heap *threads;			// our ready threads, keyed on pass
+};
+
+// The following class defines one simulated CPU, for "-ncpu N".  Each
+// CPU has its own run queue and its own notion of time: "clock" is how
+// far it has got in executing its current thread.  Only one CPU
+// executes on the host at a time; Interrupt::OneTick always hands the
+// host to the busy CPU that is furthest behind, so the interleaving is
+// deterministic, and simulated time (stats->totalTicks) is the clock of
+// the slowest busy CPU.  A CPU with nothing to run takes work from the
+// CPU with the longest run queue.
+//
+// User registers travel with the thread (SaveUserState), so they are
+// per-CPU already.  The CPUs share the one TLB in Machine, which 
+// remembers whose entries it holds: AddrSpace::RestoreState flushes it
+// only when a different address space is loaded, on whatever CPU, so
+// it never holds entries of a space other than the running one.
+
+#define MaxCpus 8
+
+class Cpu {
+  public:
+    Cpu(int cpuId);
+    ~Cpu();
+
+    int id;
+    Thread *current;			// running thread, NULL if idle
+    List *readyList;			// this CPU's run queue
+    int clock;				// ticks executed up to
+    bool preempt;			// the timer wants "current" to yield
+    int busyTicks, idleTicks;		// statistics
+    int steals;				// threads taken from other CPUs
+};
 
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
@@ -21,7 +86,8 @@ enum policy {PRIORITY, RR, MFQ};
 
 class Scheduler {
   public: 
-    Scheduler(policy _policy);          // Initialize list of ready threads
+    Scheduler(policy _policy, int ncpus = 1);	// Initialize list of 
+					// ready threads
     ~Scheduler();			// De-allocate ready list
 
     void ReadyToRun(Thread* thread);	// Thread can be dispatched.
@@ -30,12 +96,76 @@ class Scheduler {
     void Run(Thread* nextThread);	// Cause nextThread to start running
     void Print();			// Print contents of ready list
     bool higherPriorityInList();
-    void changePriority(Thread* thread, int pri);
+    bool PreemptionNeeded();		// higherPriorityInList, cached until
+					// the queues or the running thread
+					// change
+    bool QuantumExpired(Thread *thread);	// called on every timer tick;
+					// should "thread" be preempted?
+    void changePriority(Thread* thread, int pri, bool inherited = FALSE);
+					// Change a thread's priority; an
+					// "inherited" change only moves the
+					// effective priority (cf. Lock)
+    policy getPolicy() { return schedulerPolicy; }
+    void setUserTickets(int userID, int tickets);	// STRIDE only
+
+    // One-shot timer, cf. Timer::Arm
+    void ChargePeriods();		// charge the running thread the 
+					// timer ticks it has run through
+    void SetTimer();			// arm the timer for when the running
+					// thread's quantum is up
+
+    // Multiple CPUs, cf. Cpu above
+    int getNumCpus() { return numCpus; }
+    Cpu *getCpu() { return cpu; }	// the CPU we are executing on
+    Cpu *EarliestCpu();			// busy CPU that is furthest behind
+    void SwitchCpu(Cpu *to);		// hand the host to another CPU;
+					// returns when we are run again
+    bool IdleCpu();			// current thread blocked, nothing
+					// to run here: switch to a busy CPU
+    void StartIdleCpus();		// give idle CPUs work, if any
+    void TimerTickCpus();		// timer tick on every busy CPU
+    void PrintCpus();
     
   private:
     List *readyList;  		// queue of threads that are ready to run,
     policy schedulerPolicy;
-				// but not running
+				// but not running; the current CPU's queue
+    Cpu *cpus[MaxCpus];
+    int numCpus;
+    Cpu *cpu;				// the CPU we are executing on
+
+    bool Steal(Cpu *thief);		// move a thread to thief's queue
+
+    // STRIDE state.  The user of the running thread is never in
+    // userHeap; it goes back in when that thread leaves the CPU.
+    StrideUser users[MAX_USERS];
+    Heap *userHeap;			// users with ready threads
+    StrideUser *runningUser;		// user of the running thread
+    int globalPass;			// pass of the last dispatched user
+
+    List *levelQueues[MFQLevels];	// MFQ ready queues
+    int lastBoost;			// when MFQ last boosted everyone
+    int chargedPeriods;			// one-shot timer: TimerTicks periods
+					// charged to the running thread so
+					// far, counted from boot
+
+    int LevelOf(int pri);
+    void Boost();
+
+    // PreemptionNeeded's answer, good while "preemptKnown" and the
+    // running thread's priority and level are what they were
+    bool preemptKnown;
+    bool preemptCached;
+    Thread *preemptThread;
+    int preemptPri, preemptLevel;
+    void Changed() { preemptKnown = FALSE; }	// queues have changed
+
+    StrideUser *UserOf(Thread *thread);
+    void StrideReady(Thread *thread);
+    Thread *StrideNext();
+    void StrideDispatch(Thread *thread, StrideUser *user);
+    void RebaseUserPasses();
+    void RebaseThreadPasses(StrideUser *user, Thread *running);
 };
 
 #endif // SCHEDULER_H
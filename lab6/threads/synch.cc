@@ -17,6 +17,14 @@
 // re-set the interrupt state back to its original value (whether
 // that be disabled or enabled).
 //
+// The uncontended cases (P on a positive semaphore, V with nobody
+// waiting, Acquire of a FREE lock, Release with nobody waiting) skip
+// the interrupt round-trip altogether.  That is safe because the
+// simulated CPU can only switch threads when time advances, and the
+// fast paths neither advance time nor sleep: they run to completion
+// just as if interrupts were off.  Re-enabling interrupts would
+// otherwise cost an Interrupt::OneTick() every time.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -66,6 +74,13 @@ Semaphore::~Semaphore()
 void
 Semaphore::P()
 {
+    if (value > 0) {				// fast path, nobody to wait for
+        value--;
+        stats->numFastSemaphoreP++;
+        return;
+    }
+    stats->numSlowSemaphoreP++;
+
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
     
     while (value == 0) { 			// semaphore not available
@@ -90,6 +105,12 @@ void
 Semaphore::V()
 {
     Thread *thread;
+
+    if (queue->IsEmpty()) {			// fast path, nobody to wake
+        value++;
+        return;
+    }
+
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
     thread = (Thread *)queue->Remove();
@@ -99,20 +120,27 @@ Semaphore::V()
     (void) interrupt->SetLevel(oldLevel);
 }
 
-// Dummy functions -- so we can compile our later assignments 
-// Note -- without a correct implementation of Condition::Wait(), 
-// the test case in the network assignment won't work!
+//----------------------------------------------------------------------
+// Lock::Lock
+// 	Initialize a lock, so that it can be used for synchronization.
+//	The lock starts out FREE.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+bool priorityInheritance = TRUE;
+
 Lock::Lock(char* debugName)
 {
     name = debugName;
-    lockSem = new Semaphore(debugName, 1);
+    queue = new List;
     holdingThread = NULL;
 }
 
 Lock::~Lock()
 {
     holdingThread = NULL;
-    delete lockSem;
+    delete queue;
 }
 
 bool Lock::isHeldByCurrentThread()
@@ -120,23 +148,131 @@ bool Lock::isHeldByCurrentThread()
     return currentThread == holdingThread;
 }
 
+int Lock::waiterPriority()
+{
+    return queue->highestPriority();
+}
+
+//----------------------------------------------------------------------
+// Lock::DonatePriority
+// 	Lend "pri" to the holder of this lock.  If the holder is itself
+//	blocked on another lock, keep walking down the chain, so that
+//	nested inversions are resolved too.  The walk stops as soon as
+//	a holder already runs at "pri" or higher, which also ends it on
+//	a deadlock cycle, or after MaxDonationDepth locks.  Only PRIORITY
+//	has priorities to lend.
+//
+//	Assumes interrupts are disabled.
+//----------------------------------------------------------------------
+
+void Lock::DonatePriority(int pri)
+{
+    Lock *lock = this;
+    Thread *holder;
+    int depth = 0;
+
+    if (scheduler->getPolicy() != PRIORITY)
+        return;
+    while (lock != NULL && (holder = lock->holdingThread) != NULL
+                && holder->getPri() < pri && depth++ < MaxDonationDepth) {
+        scheduler->changePriority(holder, pri, TRUE);
+        lock = holder->getWaitingLock();
+        if (lock != NULL) {		// keep its wait queue sorted
+            lock->queue->Remove((void *)holder);
+            lock->queue->SortedInsert((void *)holder, pri);
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// RestorePriority
+// 	Called when "thread" gives up a lock: its effective priority falls
+//	back to its own priority, or to the highest priority still waiting
+//	on any lock it holds, whichever is larger.
+//----------------------------------------------------------------------
+
+static int inheritedPri;
+
+static void
+MaxWaiterPriority(int arg)
+{
+    Lock *lock = (Lock *)arg;
+    if (lock->waiterPriority() > inheritedPri)
+        inheritedPri = lock->waiterPriority();
+}
+
+static void
+RestorePriority(Thread *thread)
+{
+    inheritedPri = thread->getBasePri();
+    thread->getHeldLocks()->Mapcar(MaxWaiterPriority);
+    if (inheritedPri != thread->getPri())
+        scheduler->changePriority(thread, inheritedPri, TRUE);
+}
+
+//----------------------------------------------------------------------
+// Lock::Acquire
+// 	Wait until the lock is FREE, then take it.  While waiting, lend
+//	our priority to the holder.  A FREE lock is taken without
+//	touching the interrupt level.
+//----------------------------------------------------------------------
+
 void Lock::Acquire()
 {
+    if (holdingThread == NULL) {		// fast path, lock is FREE
+        holdingThread = currentThread;
+        currentThread->getHeldLocks()->Append((void *)this);
+        stats->numFastLockAcquires++;
+        return;
+    }
+    stats->numSlowLockAcquires++;
+
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
-    lockSem->P();
+    while (holdingThread != NULL) {		// lock busy, go to sleep
+        currentThread->setWaitingLock(this);
+        queue->SortedInsert((void *)currentThread, currentThread->getPri());
+        if (priorityInheritance)
+            DonatePriority(currentThread->getPri());
+        currentThread->Sleep();
+    }
+    currentThread->setWaitingLock(NULL);
     holdingThread = currentThread;
+    currentThread->getHeldLocks()->Append((void *)this);
 
     (void) interrupt->SetLevel(oldLevel);
 }
 
+//----------------------------------------------------------------------
+// Lock::Release
+// 	Set the lock FREE, give back any priority inherited through it,
+//	and wake up the highest priority waiter, if any.
+//----------------------------------------------------------------------
+
 void Lock::Release()
 {
-    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Thread *thread;
     ASSERT(currentThread == holdingThread);
 
+    if (queue->IsEmpty() && currentThread->getPri() == currentThread->getBasePri()) {
+        holdingThread = NULL;			// fast path, nobody waiting and
+        currentThread->getHeldLocks()->Remove((void *)this);
+        return;					// no priority to give back
+    }
+
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
     holdingThread = NULL;
-    lockSem->V();
+    currentThread->getHeldLocks()->Remove((void *)this);
+    if (priorityInheritance)
+        RestorePriority(currentThread);
+
+    thread = (Thread *)queue->Remove();
+    if (thread != NULL) {
+        thread->setWaitingLock(NULL);	// no longer on our queue, so a
+					// donation must not look for it here
+        scheduler->ReadyToRun(thread);
+    }
 
     (void) interrupt->SetLevel(oldLevel);
 }
@@ -144,43 +280,46 @@ void Lock::Release()
 Condition::Condition(char* debugName)
 {
     name = debugName;
-    count = 0;
-    condSem = new Semaphore(debugName, 0);
+    waiters = new List;
 }
 
 Condition::~Condition()
 {
-    delete condSem;
+    delete waiters;
 }
 
+// Each waiter sleeps on a semaphore of its own, so that a wakeup goes
+// to a thread that was waiting when it was sent.  (With one shared
+// semaphore, a thread that starts to Wait after a Broadcast can take
+// the V meant for an earlier waiter, which then sleeps for good.)
+
 void Condition::Wait(Lock* conditionLock)
 {
+    Semaphore waiter(name, 0);
+
     ASSERT(conditionLock->isHeldByCurrentThread());
 
-    count++;
+    waiters->Append((void *) &waiter);
     conditionLock->Release();
-    condSem->P();
+    waiter.P();
     conditionLock->Acquire();
 }
 
 void Condition::Signal(Lock* conditionLock)
 {
     ASSERT(conditionLock->isHeldByCurrentThread());
-    if (count == 0)
+    if (waiters->IsEmpty())
         return;
     
-    count--;
-    condSem->V();
+    ((Semaphore *) waiters->Remove())->V();
 }
 
 void Condition::Broadcast(Lock* conditionLock)
 {
     ASSERT(conditionLock->isHeldByCurrentThread());
 
-    while(count){
-        count--;
-        condSem->V();
-    }
+    while (!waiters->IsEmpty())
+        ((Semaphore *) waiters->Remove())->V();
 }
 
 
@@ -361,47 +500,248 @@ void Barrier::AlignedBarrier()
 ReaderWriterLock::ReaderWriterLock(char* debugName)
 {
     name = debugName;
-    readersCount = 0;
-    mutex = new Lock("mutex");
-    writeLock = new Lock("writeLock");
+    mutex = new Lock("rw mutex");
+    readersOK = new Condition("rw readers");
+    writersOK = new Condition("rw writers");
+    activeReaders = waitingReaders = waitingWriters = 0;
+    writing = FALSE;
+    phase = 0;
+
+    numReads = numWrites = 0;
+    readWaitTicks = writeWaitTicks = maxReadWait = maxWriteWait = 0;
+    readHoldTicks = writeHoldTicks = 0;
+    readPhaseStart = writeStart = 0;
 }
 
 ReaderWriterLock::~ReaderWriterLock()
 {
-    delete writeLock;
+    delete writersOK;
+    delete readersOK;
     delete mutex;
 }
 
+//----------------------------------------------------------------------
+// ReaderWriterLock::readAcquire
+// 	Enter as a reader.  If a writer is writing or waiting, queue
+//	behind it; writeRelease admits us together with every other
+//	queued reader, and counts us in activeReaders on our behalf.
+//----------------------------------------------------------------------
+
 void ReaderWriterLock::readAcquire()
 {
+    int start = stats->totalTicks;
+
     mutex->Acquire();
-    readersCount++;
-    if (readersCount == 1)
-        writeLock->Acquire();
+    if (writing || waitingWriters > 0) {
+        int myPhase = phase;
+
+        waitingReaders++;
+        while (phase == myPhase)
+            readersOK->Wait(mutex);
+    } else {
+        if (activeReaders == 0)
+            readPhaseStart = stats->totalTicks;
+        activeReaders++;
+    }
+
+    int waited = stats->totalTicks - start;
+    numReads++;
+    readWaitTicks += waited;
+    if (waited > maxReadWait)
+        maxReadWait = waited;
     mutex->Release();
 }
 
 void ReaderWriterLock::readRelease()
 {
     mutex->Acquire();
-    readersCount--;
-    if (writeLock->isHeldByCurrentThread()) {
-        while (readersCount != 0) {
-            mutex->Release();
-            currentThread->Yield();
-            mutex->Acquire();
-        }
-        writeLock->Release();
+    ASSERT(activeReaders > 0);
+    activeReaders--;
+    if (activeReaders == 0) {
+        readHoldTicks += stats->totalTicks - readPhaseStart;
+        if (waitingWriters > 0)
+            writersOK->Signal(mutex);
     }
     mutex->Release();
 }
 
+//----------------------------------------------------------------------
+// ReaderWriterLock::writeAcquire
+// 	Enter as a writer, once the current writer and the current batch
+//	of readers are gone.  Our presence in waitingWriters holds back
+//	any reader that arrives meanwhile.
+//----------------------------------------------------------------------
+
 void ReaderWriterLock::writeAcquire()
 {
-    writeLock->Acquire();
+    int start = stats->totalTicks;
+
+    mutex->Acquire();
+    waitingWriters++;
+    while (writing || activeReaders > 0)
+        writersOK->Wait(mutex);
+    waitingWriters--;
+    writing = TRUE;
+
+    int waited = stats->totalTicks - start;
+    numWrites++;
+    writeWaitTicks += waited;
+    if (waited > maxWriteWait)
+        maxWriteWait = waited;
+    writeStart = stats->totalTicks;
+    mutex->Release();
 }
 
+//----------------------------------------------------------------------
+// ReaderWriterLock::writeRelease
+// 	Leave as a writer.  If readers queued up behind us, admit the
+//	whole batch, even if other writers are waiting; otherwise hand
+//	the lock to the next writer.
+//----------------------------------------------------------------------
+
 void ReaderWriterLock::writeRelease()
 {
-    writeLock->Release();
-}
\ No newline at end of file
+    mutex->Acquire();
+    ASSERT(writing);
+    writing = FALSE;
+    writeHoldTicks += stats->totalTicks - writeStart;
+
+    if (waitingReaders > 0) {
+        readPhaseStart = stats->totalTicks;
+        activeReaders += waitingReaders;
+        waitingReaders = 0;
+        phase++;
+        readersOK->Broadcast(mutex);
+    } else if (waitingWriters > 0)
+        writersOK->Signal(mutex);
+    mutex->Release();
+}
+
+//----------------------------------------------------------------------
+// ReaderWriterLock::Print
+// 	Print how often the lock was taken, and how long it was held and
+//	waited for, in simulated ticks.
+//----------------------------------------------------------------------
+
+void ReaderWriterLock::Print()
+{
+    printf("ReaderWriterLock %s:\n", name);
+    printf("  reads %d, wait ticks total %d, avg %d, max %d\n", numReads,
+        readWaitTicks, numReads ? readWaitTicks / numReads : 0, maxReadWait);
+    printf("  writes %d, wait ticks total %d, avg %d, max %d\n", numWrites,
+        writeWaitTicks, numWrites ? writeWaitTicks / numWrites : 0, maxWriteWait);
+    printf("  held for reading %d ticks, for writing %d ticks\n", 
+        readHoldTicks, writeHoldTicks);
+}
+
+//----------------------------------------------------------------------
+// PipeBuffer::PipeBuffer
+// 	Initialize an empty pipe, holding up to "bufferSize" bytes, with no 
+//	ends open yet.
+//----------------------------------------------------------------------
+
+PipeBuffer::PipeBuffer(char* debugName, int bufferSize)
+{
+    ASSERT(bufferSize > 0);
+    name = debugName;
+    size = bufferSize;
+    buffer = new char[size];
+    head = count = 0;
+    readers = writers = 0;
+    lock = new Lock(debugName);
+    notEmpty = new Condition(debugName);
+    notFull = new Condition(debugName);
+}
+
+PipeBuffer::~PipeBuffer()
+{
+    delete notFull;
+    delete notEmpty;
+    delete lock;
+    delete [] buffer;
+}
+
+//----------------------------------------------------------------------
+// PipeBuffer::Read
+// 	Wait until the pipe has data, or no writers are left, then copy
+//	out up to "numBytes" bytes.  Returns how many; 0 means end of file.
+//----------------------------------------------------------------------
+
+int
+PipeBuffer::Read(char *into, int numBytes)
+{
+    int n = 0;
+
+    lock->Acquire();
+    while (count == 0 && writers > 0)
+        notEmpty->Wait(lock);
+    while (n < numBytes && count > 0) {
+        into[n++] = buffer[head];
+        head = (head + 1) % size;
+        count--;
+    }
+    if (n > 0)
+        notFull->Broadcast(lock);
+    lock->Release();
+    return n;
+}
+
+//----------------------------------------------------------------------
+// PipeBuffer::Write
+// 	Copy "numBytes" bytes into the pipe, waiting for room as needed.
+//	Returns how many were written, which is less than "numBytes" only 
+//	if every reader has gone.
+//----------------------------------------------------------------------
+
+int
+PipeBuffer::Write(char *from, int numBytes)
+{
+    int n = 0;
+
+    lock->Acquire();
+    while (n < numBytes && readers > 0) {
+        while (count == size && readers > 0)
+            notFull->Wait(lock);
+        while (n < numBytes && count < size) {
+            buffer[(head + count) % size] = from[n++];
+            count++;
+        }
+        notEmpty->Broadcast(lock);
+    }
+    lock->Release();
+    return n;
+}
+
+//----------------------------------------------------------------------
+// PipeBuffer::Open/Close
+// 	Count the ends open for reading and writing.  Closing the last
+//	end on one side wakes up whoever waits on the other side, to see
+//	end of file, or to give up writing.
+//----------------------------------------------------------------------
+
+void
+PipeBuffer::Open(bool writer)
+{
+    lock->Acquire();
+    if (writer)
+        writers++;
+    else
+        readers++;
+    lock->Release();
+}
+
+void
+PipeBuffer::Close(bool writer)
+{
+    lock->Acquire();
+    if (writer) {
+        ASSERT(writers > 0);
+        if (--writers == 0)
+            notEmpty->Broadcast(lock);
+    } else {
+        ASSERT(readers > 0);
+        if (--readers == 0)
+            notFull->Broadcast(lock);
+    }
+    lock->Release();
+}
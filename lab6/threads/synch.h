@@ -62,6 +62,13 @@ class Semaphore {
 // In addition, by convention, only the thread that acquired the lock
 // may release it.  As with semaphores, you can't read the lock value
 // (because the value might change immediately after you read it).  
+//
+// Locks implement priority inheritance: a thread that blocks in Acquire
+// lends its priority to the holder (and on down the chain, if the holder
+// is itself blocked on another lock), so that a low priority holder
+// cannot be starved by medium priority threads while a high priority
+// thread waits.  The loan is returned in Release.  Inheritance can be
+// switched off with "-npi", for comparison.
 
 class Lock {
   public:
@@ -77,13 +84,23 @@ class Lock {
 					// checking in Release, and in
 					// Condition variable ops below.
 
+    Thread *getHolder() { return holdingThread; }
+    int waiterPriority();		// highest priority among waiters,
+					// -1 if nobody is waiting
+
   private:
     char* name;				// for debugging
-    Semaphore* lockSem;
+    List *queue;			// threads waiting in Acquire,
+					// highest priority first
     Thread *holdingThread;
-    // plus some other stuff you'll need to define
+
+    void DonatePriority(int pri);	// raise the holder chain to "pri"
 };
 
+extern bool priorityInheritance;	// FALSE if "-npi" was given
+
+#define MaxDonationDepth 8		// locks a donation is passed through
+
 // The following class defines a "condition variable".  A condition
 // variable does not have a value, but threads may be queued, waiting
 // on the variable.  These are only operations on a condition variable: 
@@ -133,11 +150,9 @@ class Condition {
 
   private:
     char* name;
-    int count;
-    Semaphore* condSem;
+    List *waiters;			// a semaphore for each waiting thread
     // plus some other stuff you'll need to define
 };
-#endif // SYNCH_H
 
 //my own
 class bounded_buffer: public List {
@@ -191,6 +206,17 @@ class Barrier {
     Condition* condOut;
 };
 
+// The following class defines a phase-fair reader/writer lock.
+// Readers share the lock, writers hold it exclusively.  A reader that
+// arrives while a writer is writing or waiting queues behind that
+// writer; when the writer releases, every queued reader is admitted at
+// once as one batch, and the next writer waits only for that batch to
+// drain.  So neither a stream of readers nor a stream of writers can
+// starve the other side.
+//
+// Hold and wait times (in simulated ticks) are kept per lock, and
+// printed by Print().
+
 class ReaderWriterLock {
   public:
     ReaderWriterLock(char* debugName);
@@ -199,9 +225,56 @@ class ReaderWriterLock {
     void readRelease();
     void writeAcquire();
     void writeRelease();
+    void Print();			// print hold/wait statistics
+  public:
+    char* name;
+    Lock* mutex;			// protects everything below
+    Condition* readersOK;		// queued readers wait for a phase
+    Condition* writersOK;		// writers wait for exclusive access
+    int activeReaders;			// readers holding the lock
+    int waitingReaders;			// readers queued behind a writer
+    int waitingWriters;
+    bool writing;			// a writer holds the lock
+    int phase;				// number of completed write phases
+
+    int numReads, numWrites;		// statistics
+    int readWaitTicks, writeWaitTicks;
+    int maxReadWait, maxWriteWait;
+    int readHoldTicks, writeHoldTicks;
+    int readPhaseStart, writeStart;	// when the current hold began
+};
+
+// The following class defines a pipe: a circular buffer of bytes, in
+// memory, between any number of writers and readers.  Read waits until
+// there is at least one byte, and returns what is there (up to the
+// amount asked for); Write waits for room until it has written all of
+// its bytes.  Once the last writer has closed its end, Read returns 0
+// (end of file) on an empty pipe; once the last reader has, Write
+// gives up and returns how much it managed to write.
+
+#define PipeSize 1024			// bytes a pipe can hold
+
+class PipeBuffer {
   public:
+    PipeBuffer(char* debugName, int bufferSize);
+    ~PipeBuffer();
+    int Read(char *into, int numBytes);
+    int Write(char *from, int numBytes);
+
+    void Open(bool writer);		// one more reader or writer
+    void Close(bool writer);		// one fewer
+    bool IsClosed() { return readers == 0 && writers == 0; }
+
+  private:
     char* name;
-    int readersCount;
-    Lock* mutex;
-    Lock* writeLock;
+    char *buffer;
+    int size;
+    int head;				// next byte to read
+    int count;				// bytes in the pipe
+    int readers, writers;		// ends still open
+    Lock *lock;				// protects everything above
+    Condition *notEmpty;		// readers wait for data
+    Condition *notFull;			// writers wait for room
 };
+
+#endif // SYNCH_H
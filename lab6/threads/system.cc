@@ -7,6 +7,7 @@
 
 #include "copyright.h"
 #include "system.h"
+#include "synch.h"
 
 // This defines *all* of the global data structures used by Nachos.
 // These are all initialized and de-allocated by this file.
@@ -18,6 +19,9 @@ Interrupt *interrupt;			// interrupt status
 Statistics *stats;			// performance metrics
 Timer *timer;				// the hardware timer device,
 					// for invoking context switches
+bool psOnExit = FALSE;			// "-ps" was given
+bool slowTick = FALSE;			// "-slowtick" was given
+bool traceCheck = FALSE;		// "-tc" was given
 
 #ifdef FILESYS_NEEDED
 FileSystem  *fileSystem;
@@ -25,6 +29,13 @@ FileSystem  *fileSystem;
 
 #ifdef FILESYS
 SynchDisk   *synchDisk;
+bool diskMapped = FALSE;
+int diskSyncEvery = 0;
+int diskSectorsPerTrack = DefaultSectorsPerTrack;
+int diskNumTracks = DefaultNumTracks;
+bool readAhead = TRUE;
+bool writeBehind = TRUE;
+bool journaling = TRUE;
 #endif
 
 #ifdef USER_PROGRAM	// requires either FILESYS or FILESYS_STUB
@@ -54,17 +65,34 @@ extern void Cleanup();
 //	if the interrupted thread called Yield at the point it is 
 //	was interrupted.
 //
+//	A one-shot timer only interrupts when the running thread's 
+//	quantum is (about to be found) up, and the thread is charged for 
+//	the ticks since it was last charged, rather than for one.
+//
 //	"dummy" is because every interrupt handler takes one argument,
 //		whether it needs it or not.
 //----------------------------------------------------------------------
 static void
 TimerInterruptHandler(int dummy)
 {
+    if (scheduler->getNumCpus() > 1) {
+        scheduler->TimerTickCpus();
+        return;
+    }
+    if (timer->IsOneShot()) {
+        if (interrupt->getStatus() == IdleMode)
+            return;
+        scheduler->ChargePeriods();
+        if (scheduler->QuantumExpired(currentThread))
+            interrupt->YieldOnReturn();
+        else
+            scheduler->SetTimer();
+        return;
+    }
     currentThread->addTicks();
-    if (interrupt->getStatus() != IdleMode && currentThread->checkRunningTime()){
-        scheduler->changePriority(currentThread, currentThread->getPri() - 1);
+    if (interrupt->getStatus() != IdleMode 
+            && scheduler->QuantumExpired(currentThread))
 	    interrupt->YieldOnReturn();
-    }
 }
 
 //----------------------------------------------------------------------
@@ -82,8 +110,10 @@ Initialize(int argc, char **argv)
 {
     int argCount;
     policy argPolicy = PRIORITY;
+    int numCpus = 1;
     char* debugArgs = "";
     bool randomYield = FALSE;
+    bool periodicTimer = FALSE;
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE;	// single step user program
@@ -91,6 +121,13 @@ Initialize(int argc, char **argv)
 #ifdef FILESYS_NEEDED
     bool format = FALSE;	// format disk
 #endif
+#ifdef FILESYS
+    char *diskName = "DISK";	// UNIX file holding the disk
+    int cacheSectors = CacheSectors;	// sector cache size, 0 for none
+    DiskPolicy diskPolicy = CLOOK;
+    int numDisks = 1;		// to stripe the sectors across
+    char *ioTraceName = NULL;	// "-iotrace": where to trace disk requests
+#endif
 #ifdef NETWORK
     double rely = 1;		// network reliability
     int netname = 0;		// UNIX socket name
@@ -113,9 +150,23 @@ Initialize(int argc, char **argv)
 	    argCount = 2;
 	} else if (!strcmp(*argv, "--policy")) {
 	    ASSERT(argc > 1);
-	    argPolicy = policy(atoi(*(argv + 1)));	// initialize pseudo-random
-						// number generator
+	    argPolicy = policy(atoi(*(argv + 1)));	// 0 PRIORITY, 1 RR,
+						// 2 MFQ, 3 STRIDE
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-ncpu")) {
+	    ASSERT(argc > 1);
+	    numCpus = atoi(*(argv + 1));	// simulated CPUs
 	    argCount = 2;
+	} else if (!strcmp(*argv, "-ps")) {
+	    psOnExit = TRUE;			// report where time went
+	} else if (!strcmp(*argv, "-periodic")) {
+	    periodicTimer = TRUE;		// interrupt every TimerTicks
+	} else if (!strcmp(*argv, "-slowtick")) {
+	    slowTick = TRUE;			// no short cuts in OneTick
+	} else if (!strcmp(*argv, "-tc")) {
+	    traceCheck = TRUE;			// verify the short cuts
+	} else if (!strcmp(*argv, "-npi")) {
+	    priorityInheritance = FALSE;	// plain locks, for comparison
 	}
 #ifdef USER_PROGRAM
 	if (!strcmp(*argv, "-s"))
@@ -125,6 +176,46 @@ Initialize(int argc, char **argv)
 	if (!strcmp(*argv, "-f"))
 	    format = TRUE;
 #endif
+#ifdef FILESYS
+	if (!strcmp(*argv, "-disk")) {
+	    ASSERT(argc > 1);
+	    diskName = *(argv + 1);
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-nc")) {
+	    cacheSectors = 0;			// no sector cache
+	} else if (!strcmp(*argv, "-mmap")) {
+	    diskMapped = TRUE;			// memcpy, not read and write
+	} else if (!strcmp(*argv, "-msync")) {
+	    ASSERT(argc > 1);
+	    diskSyncEvery = atoi(*(argv + 1));
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-nra")) {
+	    readAhead = FALSE;			// no read-ahead in OpenFile
+	} else if (!strcmp(*argv, "-nwb")) {
+	    writeBehind = FALSE;		// every Write goes to WriteAt
+	} else if (!strcmp(*argv, "-nj")) {
+	    journaling = FALSE;			// metadata goes straight to
+						// the cache
+	} else if (!strcmp(*argv, "-dg")) {
+	    ASSERT(argc > 2);
+	    diskSectorsPerTrack = atoi(*(argv + 1));	// for a new disk;
+	    diskNumTracks = atoi(*(argv + 2));	// an old one has its own
+	    argCount = 3;
+	} else if (!strcmp(*argv, "-disks")) {
+	    ASSERT(argc > 1);
+	    numDisks = atoi(*(argv + 1));	// DISK.0, DISK.1, ...
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-iotrace")) {
+	    ASSERT(argc > 1);
+	    ioTraceName = *(argv + 1);
+	    argCount = 2;
+	} else if (!strcmp(*argv, "-dp")) {
+	    ASSERT(argc > 1);
+	    diskPolicy = DiskPolicy(atoi(*(argv + 1)));	// 0 FCFS, 1 SSTF,
+						// 2 SCAN, 3 C-LOOK
+	    argCount = 2;
+	}
+#endif
 #ifdef NETWORK
 	if (!strcmp(*argv, "-l")) {
 	    ASSERT(argc > 1);
@@ -141,14 +232,11 @@ Initialize(int argc, char **argv)
     DebugInit(debugArgs);			// initialize DEBUG messages
     stats = new Statistics();			// collect statistics
     interrupt = new Interrupt;			// start up interrupt handling
-    scheduler = new Scheduler(argPolicy);		// initialize the ready queue
-    if (randomYield || argPolicy == RR || argPolicy == MFQ)				// start the timer (if needed)
-	    timer = new Timer(TimerInterruptHandler, 0, randomYield);
+    scheduler = new Scheduler(argPolicy, numCpus);		// initialize the ready queue
+    if (randomYield || argPolicy == RR || argPolicy == MFQ || argPolicy == STRIDE)				// start the timer (if needed)
+	    timer = new Timer(TimerInterruptHandler, 0, randomYield,
+		!randomYield && !periodicTimer && numCpus == 1);
     
-    for (int i = 0; i < MAX_TID; i++){
-        threadIdPool.push(i);
-    }
-
     threadToBeDestroyed = NULL;
 
     // We didn't explicitly allocate the current thread we are running in.
@@ -156,6 +244,8 @@ Initialize(int argc, char **argv)
     // object to save its state. 
     currentThread = new Thread("main");		
     currentThread->setStatus(RUNNING);
+    scheduler->getCpu()->current = currentThread;
+    scheduler->SetTimer();
 
     interrupt->Enable();
     CallOnUserAbort(Cleanup);			// if user hits ctl-C
@@ -165,7 +255,10 @@ Initialize(int argc, char **argv)
 #endif
 
 #ifdef FILESYS
-    synchDisk = new SynchDisk("DISK");
+    synchDisk = new SynchDisk(diskName, cacheSectors, numDisks);
+    synchDisk->setPolicy(diskPolicy);
+    if (ioTraceName != NULL)
+        synchDisk->StartTrace(ioTraceName);
 #endif
 
 #ifdef FILESYS_NEEDED
@@ -215,15 +308,34 @@ void TS(){
     printf("--------------Invoke TS()--------------\n");
     printf("%s\t\t%s\t\t%s\t\t%s\t%s\t\t%s\n", "Name", "Tid", "UserID", "Priority", "TimeSlice", "Status");
 
-    const threadPtr* tVecRef = Thread::getPtrVec();
-
     Thread *tPtr;
-    for (int i = 0; i < MAX_TID; i++){
-        tPtr = tVecRef[i];
+    for (int i = 0; i < threadTable->NumSlots(); i++){
+        tPtr = threadTable->InSlot(i);
         if (tPtr == NULL)
             continue;
         printf("%s\t\t%d\t\t%d\t\t%d\t\t%d\t\t%s\n", tPtr->getName(), tPtr->getTid(), tPtr->getUsrID(), tPtr->getPri(), tPtr->getTimeSlice(), statusName[int(tPtr->getStatus())]);
     }
     tPtr = NULL;
     printf("--------------Exit TS()--------------\n");
-}
\ No newline at end of file
+}
+
+//----------------------------------------------------------------------
+// PS
+// 	Print where each live thread's time went (ticks running in user 
+//	and kernel mode, waiting on a run queue, and blocked; and how
+//	often it gave up the CPU voluntarily or not), followed by the
+//	run queue wait histograms.  With "-ps", threads print their own
+//	line when they finish, and PS() runs at halt (without the 
+//	histograms, which Statistics::Print has just printed).
+//----------------------------------------------------------------------
+
+void PS(bool histograms){
+    printf("%-12s %4s %-6s %8s %8s %8s %8s %6s %6s\n", "Name", "Tid", 
+        "Status", "User", "System", "Ready", "Blocked", "Vol", "Invol");
+
+    for (int i = 0; i < threadTable->NumSlots(); i++)
+        if (threadTable->InSlot(i) != NULL)
+            threadTable->InSlot(i)->PrintAccounting();
+    if (histograms)
+        stats->PrintReadyWait();
+}
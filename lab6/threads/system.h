@@ -17,11 +17,15 @@
 #include "timer.h"
 #include "machine.h"
 
-#define MAX_TID 128
-
-#define MAXPIPELEN 1024
-
 extern void TS();
+extern void PS(bool histograms = TRUE);		// per-thread accounting, and
+						// run queue wait histograms
+extern bool psOnExit;				// "-ps": PS() at halt, and a
+						// line for each thread exiting
+extern bool slowTick;				// "-slowtick": OneTick always
+						// checks everything
+extern bool traceCheck;				// "-tc": check each short-cut
+						// OneTick takes
 
 // Initialization and cleanup routines
 extern void Initialize(int argc, char **argv); 	// Initialization,
@@ -49,6 +53,12 @@ extern FileSystem  *fileSystem;
 #ifdef FILESYS
 #include "synchdisk.h"
 extern SynchDisk   *synchDisk;
+extern bool diskMapped;				// "-mmap": map the disk file
+extern int diskSyncEvery;			// "-msync n": msync it after
+						// every n writes
+extern bool readAhead;				// FALSE if "-nra" was given
+extern bool writeBehind;			// FALSE if "-nwb" was given
+extern bool journaling;				// FALSE if "-nj" was given
 #endif
 
 #ifdef NETWORK
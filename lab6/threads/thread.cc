@@ -27,8 +27,118 @@
 					// execution stack, for detecting 
 					// stack overflows
 
-std::queue<int> threadIdPool;
-threadPtr* Thread::threadPtrVec = new threadPtr[MAX_TID]();
+ThreadTable *threadTable = new ThreadTable(128);
+
+//----------------------------------------------------------------------
+// ThreadTable::ThreadTable
+// 	Make an empty thread table, with room for "initialSize" threads
+//	before it has to grow.  Slots are handed out lowest first.
+//----------------------------------------------------------------------
+
+ThreadTable::ThreadTable(int initialSize)
+{
+    ASSERT(initialSize > 0);
+    size = initialSize;
+    slots = new ThreadSlot[size];
+    for (int i = 0; i < size; i++) {
+        slots[i].thread = NULL;
+        slots[i].generation = 0;
+        slots[i].nextFree = (i + 1 < size) ? i + 1 : -1;
+    }
+    freeHead = 0;
+    inUse = 0;
+}
+
+ThreadTable::~ThreadTable()
+{
+    delete [] slots;
+}
+
+//----------------------------------------------------------------------
+// ThreadTable::Grow
+// 	Double the table.  The new slots go on the free list in order,
+//	so ids keep being handed out lowest first.
+//----------------------------------------------------------------------
+
+void
+ThreadTable::Grow()
+{
+    int newSize = size * 2;
+    ThreadSlot *newSlots;
+
+    ASSERT(newSize <= (1 << TidSlotBits));
+    newSlots = new ThreadSlot[newSize];
+    for (int i = 0; i < size; i++)
+        newSlots[i] = slots[i];
+    for (int i = size; i < newSize; i++) {
+        newSlots[i].thread = NULL;
+        newSlots[i].generation = 0;
+        newSlots[i].nextFree = (i + 1 < newSize) ? i + 1 : freeHead;
+    }
+    freeHead = size;
+    delete [] slots;
+    slots = newSlots;
+    size = newSize;
+}
+
+//----------------------------------------------------------------------
+// ThreadTable::Add
+// 	Give "thread" the free slot at the head of the free list, and 
+//	return its tid (the slot number, tagged with its generation).
+//----------------------------------------------------------------------
+
+int
+ThreadTable::Add(Thread *thread)
+{
+    int i;
+
+    if (freeHead == -1)
+        Grow();
+    i = freeHead;
+    freeHead = slots[i].nextFree;
+    slots[i].thread = thread;
+    slots[i].nextFree = -1;
+    inUse++;
+    return (slots[i].generation << TidSlotBits) | i;
+}
+
+//----------------------------------------------------------------------
+// ThreadTable::Remove
+// 	Free the slot of "tid", if "tid" is still current.  The slot's
+//	generation moves on, so that "tid" goes stale.
+//----------------------------------------------------------------------
+
+void
+ThreadTable::Remove(int tid)
+{
+    int i = tid & ((1 << TidSlotBits) - 1);
+
+    if (Lookup(tid) == NULL)		// already removed
+        return;
+    slots[i].thread = NULL;
+    slots[i].generation = (slots[i].generation + 1) % MaxGeneration;
+    slots[i].nextFree = freeHead;
+    freeHead = i;
+    inUse--;
+}
+
+//----------------------------------------------------------------------
+// ThreadTable::Lookup
+// 	Return the thread whose id is "tid".  NULL if that thread has 
+//	finished, or "tid" is garbage (it may come from a user program).
+//----------------------------------------------------------------------
+
+Thread *
+ThreadTable::Lookup(int tid)
+{
+    int i = tid & ((1 << TidSlotBits) - 1);
+
+    if (tid < 0 || i >= size || slots[i].thread == NULL)
+        return NULL;
+    if (slots[i].generation != (tid >> TidSlotBits))
+        return NULL;			// stale: the slot was reused
+    return slots[i].thread;
+}
 
 //----------------------------------------------------------------------
 // Thread::Thread
@@ -41,17 +151,21 @@ threadPtr* Thread::threadPtrVec = new threadPtr[MAX_TID]();
 
 Thread::Thread(char* threadName)
 {
-    if (threadIdPool.empty())
-        fprintf(stderr, "Error!Exceeds the maximum number of threads available.\n");
-    ASSERT(!threadIdPool.empty());
-    
-    tid = threadIdPool.front();
-    threadIdPool.pop();
+    tid = threadTable->Add(this);
 
     userID = 0;
-    priority = MAX_PRIORITY;
+    priority = basePriority = MAX_PRIORITY;
     timeTicks = 0;
+    level = 0;
+    cpu = 0;
     timeSlice = 100;
+    waitingLock = NULL;
+    heldLocks = new List;
+    tickets = DEFAULT_TICKETS;
+    pass = 0;
+    userTicks = systemTicks = readyTicks = blockedTicks = 0;
+    voluntarySwitches = involuntarySwitches = 0;
+    statusSince = stats->totalTicks;
 
     name = threadName;
     stackTop = NULL;
@@ -59,23 +173,28 @@ Thread::Thread(char* threadName)
     status = JUST_CREATED;         
 #ifdef USER_PROGRAM
     space = NULL;
+    stdIds[0] = stdIds[1] = ConsoleId;
 #endif
 
-    threadPtrVec[tid] = this;
 }
 
 Thread::Thread(char* threadName, int _pri) : priority(min(max(_pri, 0), MAX_PRIORITY))
 {
-    if (threadIdPool.empty())
-        fprintf(stderr, "Error!Exceeds the maximum number of threads available.\n");
-    ASSERT(!threadIdPool.empty());
-    
-    tid = threadIdPool.front();
-    threadIdPool.pop();
+    tid = threadTable->Add(this);
 
     userID = 0;
+    basePriority = priority;
     timeTicks = 0;
+    level = 0;
+    cpu = 0;
     updateTimeSlice();
+    waitingLock = NULL;
+    heldLocks = new List;
+    tickets = DEFAULT_TICKETS;
+    pass = 0;
+    userTicks = systemTicks = readyTicks = blockedTicks = 0;
+    voluntarySwitches = involuntarySwitches = 0;
+    statusSince = stats->totalTicks;
 
     name = threadName;
     stackTop = NULL;
@@ -83,15 +202,55 @@ Thread::Thread(char* threadName, int _pri) : priority(min(max(_pri, 0), MAX_PRIO
     status = JUST_CREATED;         
 #ifdef USER_PROGRAM
     space = NULL;
+    stdIds[0] = stdIds[1] = ConsoleId;
 #endif
 
-    threadPtrVec[tid] = this;
 }
 
+//----------------------------------------------------------------------
+// Thread::updateTimeSlice
+// 	MFQ gives lower priorities longer slices, 
+//	100 * sqrt((MAX_PRIORITY + 1) / (priority + 1)) ticks.  The slices
+//	are worked out once, rather than on every priority change.
+//----------------------------------------------------------------------
+
 void 
 Thread::updateTimeSlice()
 { 
-    timeSlice = 100 * sqrt((MAX_PRIORITY + 1) * 1.0 / (priority + 1)); 
+    static int sliceTable[MAX_PRIORITY + 1];
+
+    if (sliceTable[0] == 0)
+        for (int i = 0; i <= MAX_PRIORITY; i++)
+            sliceTable[i] = 100 * sqrt((MAX_PRIORITY + 1) * 1.0 / (i + 1));
+    timeSlice = sliceTable[priority]; 
+}
+
+//----------------------------------------------------------------------
+// Thread::setPri
+// 	Set our own priority.  The effective priority is that, or the
+//	highest priority waiting on a lock we hold, if that is higher, so 
+//	a priority lent to us survives until we release the lock.
+//----------------------------------------------------------------------
+
+static int lentPri;
+
+static void
+MaxLentPriority(int arg)
+{
+    Lock *lock = (Lock *)arg;
+
+    if (lock->waiterPriority() > lentPri)
+        lentPri = lock->waiterPriority();
+}
+
+void
+Thread::setPri(int _pri)
+{
+    basePriority = _pri;
+    lentPri = _pri;
+    if (priorityInheritance && heldLocks != NULL)
+        heldLocks->Mapcar(MaxLentPriority);
+    priority = lentPri;
 }
 
 //----------------------------------------------------------------------
@@ -113,9 +272,13 @@ Thread::~Thread()
     ASSERT(this != currentThread);
     if (stack != NULL)
 	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+    delete heldLocks;
+#ifdef USER_PROGRAM
+    if (machine->registers == userRegisters)	// exited without a save
+	machine->registers = machine->spareRegisters;
+#endif
 
-    threadPtrVec[tid] = NULL;
-    threadIdPool.push(tid);
+    threadTable->Remove(tid);		// unless Finish already did
 }
 
 //----------------------------------------------------------------------
@@ -178,6 +341,51 @@ Thread::CheckOverflow()
 #endif
 }
 
+//----------------------------------------------------------------------
+// Thread::setStatus
+// 	Change the thread's state, charging the time spent in the old
+//	state.  A switch out that blocks the thread is voluntary; one
+//	that leaves it ready (a time slice, a preemption, or a Yield) is
+//	involuntary.  Time spent on a run queue is also recorded in the
+//	wait histogram of the current scheduling policy.
+//----------------------------------------------------------------------
+
+void
+Thread::setStatus(ThreadStatus st)
+{
+    int waited = stats->totalTicks - statusSince;
+
+    if (st == status)			// e.g. requeued on a priority change
+        return;
+    if (status == READY) {
+        readyTicks += waited;
+        if (st == RUNNING)
+            stats->RecordReadyWait(scheduler->getPolicy(), waited);
+    } else if (status == BLOCKED)
+        blockedTicks += waited;
+    else if (status == RUNNING && st == BLOCKED)
+        voluntarySwitches++;
+    else if (status == RUNNING && st == READY)
+        involuntarySwitches++;
+    status = st;
+    statusSince = stats->totalTicks;
+}
+
+//----------------------------------------------------------------------
+// Thread::PrintAccounting
+// 	Print where the thread's time went, as one line of PS() output.
+//----------------------------------------------------------------------
+
+void
+Thread::PrintAccounting()
+{
+    const char *statusName[4] = { "NEW", "RUN", "READY", "BLOCK" };
+
+    printf("%-12s %4d %-6s %8d %8d %8d %8d %6d %6d\n", name, tid, 
+        statusName[int(status)], userTicks, systemTicks, readyTicks, 
+        blockedTicks, voluntarySwitches, involuntarySwitches);
+}
+
 //----------------------------------------------------------------------
 // Thread::Finish
 // 	Called by ThreadRoot when a thread is done executing the 
@@ -202,8 +410,10 @@ Thread::Finish ()
     
     DEBUG('t', "Finishing thread \"%s\"\n", getName());
     
+    if (psOnExit)
+        PrintAccounting();
     threadToBeDestroyed = currentThread;
-    threadPtrVec[tid] = NULL;
+    threadTable->Remove(tid);			// Join can return now
     Sleep();					// invokes SWITCH
     // not reached
 }
@@ -243,6 +453,7 @@ Thread::Yield ()
     }
     else {
         currentThread->clearTicks();
+        scheduler->SetTimer();		// a new slice, on our own
     }
     (void) interrupt->SetLevel(oldLevel);
 }
@@ -276,9 +487,13 @@ Thread::Sleep ()
     
     DEBUG('t', "Sleeping thread \"%s\"\n", getName());
 
-    status = BLOCKED;
-    while ((nextThread = scheduler->FindNextToRun()) == NULL)
-	    interrupt->Idle();	// no one to run, wait for an interrupt
+    setStatus(BLOCKED);
+    scheduler->SetTimer();		// nothing to preempt now
+    while ((nextThread = scheduler->FindNextToRun()) == NULL) {
+        if (scheduler->IdleCpu())	// another CPU ran meanwhile, and
+            return;			// we have been woken up and run again
+        interrupt->Idle();		// no one to run, wait for an interrupt
+    }
     
     scheduler->Run(nextThread); // returns when we've been signalled
 }
@@ -351,13 +566,21 @@ Thread::StackAllocate (VoidFunctionPtr func, void *arg)
 //	Note that a user program thread has *two* sets of CPU registers -- 
 //	one for its state while executing user code, one for its state 
 //	while executing kernel code.  This routine saves the former.
+//
+//	The machine works directly on userRegisters while we run, so
+//	normally there is nothing to copy: we only detach our register
+//	file.  The exception is a thread that got its address space
+//	while running, whose registers are still in the spare set.
 //----------------------------------------------------------------------
 
 void
 Thread::SaveUserState()
 {
-    for (int i = 0; i < NumTotalRegs; i++)
-	    userRegisters[i] = machine->ReadRegister(i);
+    if (machine->registers != userRegisters) {	// set up in the spare
+	for (int i = 0; i < NumTotalRegs; i++)	// register file; copy once
+	    userRegisters[i] = machine->registers[i];
+    }
+    machine->registers = machine->spareRegisters;
 }
 
 //----------------------------------------------------------------------
@@ -366,13 +589,13 @@ Thread::SaveUserState()
 //
 //	Note that a user program thread has *two* sets of CPU registers -- 
 //	one for its state while executing user code, one for its state 
-//	while executing kernel code.  This routine restores the former.
+//	while executing kernel code.  This routine restores the former,
+//	by attaching our register file to the machine.
 //----------------------------------------------------------------------
 
 void
 Thread::RestoreUserState()
 {
-    for (int i = 0; i < NumTotalRegs; i++)
-	    machine->WriteRegister(i, userRegisters[i]);
+    machine->registers = userRegisters;
 }
 #endif
@@ -36,9 +36,7 @@
 
 #ifndef THREAD_H
 #define THREAD_H
-#define threadPtr Thread*
 
-#include <queue>
 #include "copyright.h"
 #include "utility.h"
 
@@ -58,16 +56,66 @@
 #define StackSize	(4 * 1024)	// in words
 
 #define MAX_PRIORITY 31
+#define DEFAULT_TICKETS 100		// stride scheduling share, cf. scheduler.h
+#define ConsoleId 2			// open file id of the console itself
 
 
 // Thread state
 enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED };
 
-extern std::queue<int> threadIdPool;
 
 // external function, dummy routine whose sole job is to call Thread::Print
 extern void ThreadPrint(int arg);
 
+class Lock;
+class List;
+class Thread;
+
+// The following class maps thread ids to threads.  The slots live in
+// one array, which doubles when it fills up; free slots are chained
+// through the array, most recently freed first, so allocating, freeing
+// and looking up an id are all O(1).
+//
+// A tid is a slot number tagged with the slot's generation, which is
+// bumped every time the slot is freed.  So a tid held on to after its
+// thread is gone (say, by a late Join) does not find the slot's next
+// occupant -- Lookup returns NULL instead.
+
+#define TidSlotBits	20			// at most 1M threads at once
+#define MaxGeneration	(1 << (31 - TidSlotBits))
+
+struct ThreadSlot {
+    Thread *thread;			// NULL if the slot is free
+    int generation;			// bumped when the slot is freed
+    int nextFree;			// next free slot, if free, or -1
+};
+
+class ThreadTable {
+  public:
+    ThreadTable(int initialSize);	// make an empty table
+    ~ThreadTable();
+
+    int Add(Thread *thread);		// put "thread" in a free slot,
+					// return its tid
+    void Remove(int tid);		// free the slot of "tid"
+    Thread *Lookup(int tid);		// the thread with id "tid", or NULL
+					// if it has gone (or never was)
+
+    int NumSlots() { return size; }	// for walking the table:
+    Thread *InSlot(int i) { return slots[i].thread; }	// NULL if free
+    int NumInUse() { return inUse; }
+
+  private:
+    ThreadSlot *slots;
+    int size;				// number of slots
+    int inUse;				// number of slots holding a thread
+    int freeHead;			// first free slot, or -1
+
+    void Grow();			// double the number of slots
+};
+
+extern ThreadTable *threadTable;	// every thread that has not finished
+
 // The following class defines a "thread control block" -- which
 // represents a single thread of execution.
 //
@@ -94,8 +142,6 @@ class Thread {
 					// must not be running when delete 
 					// is called
 
-    static const threadPtr* getPtrVec() { return threadPtrVec; }
-
 
     // basic thread operations
     void Fork(VoidFunctionPtr func, void *arg); 	// Make thread run (*func)(arg)
@@ -107,7 +153,7 @@ class Thread {
     
     void CheckOverflow();   			// Check if thread has 
 						// overflowed its stack
-    void setStatus(ThreadStatus st) { status = st; }
+    void setStatus(ThreadStatus st);		// also does the accounting below
     char* getName() { return (name); }
 
     int getTid() { return tid; }
@@ -131,20 +177,53 @@ class Thread {
 					// Used internally by Fork()
     int tid;
     int userID;
-    static threadPtr* threadPtrVec;
 
-    int priority;
+    int priority;			// effective priority, may be inherited
+    int basePriority;			// priority before any inheritance
     int timeSlice;
     int timeTicks;
+    int level;				// MFQ queue, 0 is the highest
+    int cpu;				// CPU whose run queue we are on
+
+    Lock *waitingLock;			// lock we are blocked on, if any
+    List *heldLocks;			// locks we currently hold
+
+    int tickets;			// share of our user's CPU time (STRIDE)
+    int pass;				// virtual time we have run (STRIDE)
+
+    // accounting, in simulated ticks; cf. PS() in system.cc
+    int userTicks, systemTicks;		// time spent running
+    int readyTicks, blockedTicks;	// time spent waiting
+    int voluntarySwitches;		// gave up the CPU by blocking
+    int involuntarySwitches;		// preempted, or yielded
+    int statusSince;			// when "status" last changed
 
   public:
     int getPri() { return priority; }
-    void setPri(int _pri) { priority = _pri; }
+    void setPri(int _pri);		// our own priority; keeps any loan
+    int getBasePri() { return basePriority; }
+    void inheritPri(int _pri) { priority = _pri; }
+    Lock *getWaitingLock() { return waitingLock; }
+    void setWaitingLock(Lock *lock) { waitingLock = lock; }
+    List *getHeldLocks() { return heldLocks; }
     void addTicks() { timeTicks += 1; }
     int getTimeSlice() { return timeSlice; }
     void updateTimeSlice();
     bool checkRunningTime() { return timeTicks >= timeSlice; }
     void clearTicks() { timeTicks = 0; }
+    void setTicks(int t) { timeTicks = t; }
+    int getTicks() { return timeTicks; }
+    int getLevel() { return level; }
+    void setLevel(int l) { level = l; timeTicks = 0; }
+    int getCpu() { return cpu; }
+    void setCpu(int c) { cpu = c; }
+    int getTickets() { return tickets; }
+    void setTickets(int n) { ASSERT(n > 0); tickets = n; }
+    int getPass() { return pass; }
+    void setPass(int p) { pass = p; }
+    void chargeTicks(bool user, int n)
+	{ if (user) userTicks += n; else systemTicks += n; }
+    void PrintAccounting();		// one line of PS() output
 
 #ifdef USER_PROGRAM
 // A thread running a user program actually has *two* sets of CPU registers -- 
@@ -158,6 +237,9 @@ class Thread {
     void RestoreUserState();		// restore user-level register state
 
     AddrSpace *space;			// User code this thread is running.
+    int stdIds[2];			// what ConsoleInput and ConsoleOutput
+					// refer to, -1 if closed; initially
+					// ConsoleId (cf. exception.cc)
 #endif
 
 };
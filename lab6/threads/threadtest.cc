@@ -92,32 +92,47 @@ void barrierTest(Barrier* barrier)
     }
 }
 
+static int rwReaders, rwWriters;	// threads inside the lock now
+static int rwDone;			// threads that have finished
+
 void readTest(ReaderWriterLock* RW)
 {
     for (int i = 0; i < 3; i++) {
         RW->readAcquire();
+        rwReaders++;
         printf("%s starts reading!\n", currentThread->getName());
-        for (int j = 0; j < 10; j++)
+        for (int j = 0; j < 10; j++) {
+            ASSERT(rwWriters == 0);
             currentThread->Yield();
+        }
         printf("%s finishes reading!\n", currentThread->getName());
+        ASSERT(rwWriters == 0);
+        rwReaders--;
         RW->readRelease();
         for (int j = 0; j < 10; j++)
             currentThread->Yield();
     }
+    rwDone++;
 }
 
 void writeTest(ReaderWriterLock* RW)
 {
     for (int i = 0; i < 3; i++) {
         RW->writeAcquire();
+        rwWriters++;
         printf("%s starts writing!\n", currentThread->getName());
-        for (int j = 0; j < 10; j++)
+        for (int j = 0; j < 10; j++) {
+            ASSERT(rwWriters == 1 && rwReaders == 0);
             currentThread->Yield();
+        }
         printf("%s finishes writeing!\n", currentThread->getName());
+        ASSERT(rwWriters == 1 && rwReaders == 0);
+        rwWriters--;
         RW->writeRelease();
         for (int j = 0; j < 10; j++)
             currentThread->Yield();
     }
+    rwDone++;
 }
 
 //----------------------------------------------------------------------
@@ -154,20 +169,54 @@ void ThreadTestInExercise3()
     IdTest(currentThread->getTid());
 }
 
+//----------------------------------------------------------------------
+// ThreadTestInExercise4_maxTid
+// 	There is no longer a fixed limit on threads.  Create ManyThreads
+//	threads, ManyWave at a time, each of which just exits; then check 
+//	that the tid of a thread from the first wave has gone stale, even
+//	though its slot has been reused since.
+//----------------------------------------------------------------------
+
+#define ManyThreads	20000
+#define ManyWave	1000
+
+static Semaphore *manyDone;
+
+void ManyThread(int which)
+{
+    manyDone->V();
+}
+
 void ThreadTestInExercise4_maxTid()
 {
     DEBUG('t', "Enter ThreadTestInExercise4_maxTid");
 
     Thread *t;
-
-    printf("Thread 0 (name=%s, tid=%d)\n", currentThread->getName(), currentThread->getTid());
-    for (int i = 1; i <= 127; i++){
-        t = new Thread("fork");
-        printf("Thread %d (name=%s, tid=%d)\n", i, t->getName(), t->getTid());
+    int firstTid = -1;
+
+    manyDone = new Semaphore("many done", 0);
+    for (int i = 0; i < ManyThreads; i += ManyWave) {
+        for (int j = 0; j < ManyWave; j++) {
+            t = new Thread("many");
+            if (firstTid == -1)
+                firstTid = t->getTid();
+            t->Fork(ManyThread, (void *)(i + j));
+        }
+        for (int j = 0; j < ManyWave; j++)
+            manyDone->P();
     }
-    
-    printf("\nCreate the 128th thread:(counting from 0)\n");
-    t = new Thread("test MAX_TID");
+    printf("%d threads created, %d slots in the thread table, %d in use\n",
+        ManyThreads, threadTable->NumSlots(), threadTable->NumInUse());
+    printf("first tid %d is %s\n", firstTid, 
+        threadTable->Lookup(firstTid) == NULL ? "stale" : "STILL LIVE");
+    ASSERT(threadTable->Lookup(firstTid) == NULL);
+    ASSERT(threadTable->NumSlots() < ManyThreads);	// slots were reused
+
+    t = new Thread("many");		// a fresh tid, even in an old slot
+    ASSERT(t->getTid() != firstTid && threadTable->Lookup(t->getTid()) == t);
+    delete t;
+    ASSERT(threadTable->Lookup(firstTid) == NULL);
+    delete manyDone;
 }
 
 void ThreadTestInExercise4_TS()
@@ -297,6 +346,7 @@ void ThreadTestInLab3Challenge2()
 
     ReaderWriterLock* RW = new ReaderWriterLock("BarrierTest");
 
+    rwReaders = rwWriters = rwDone = 0;
     t1->Fork(readTest, (void *)RW);
     t2->Fork(writeTest, (void *)RW);
     t3->Fork(readTest, (void *)RW);
@@ -304,10 +354,518 @@ void ThreadTestInLab3Challenge2()
     
 
     currentThread->setPri(0);
-    currentThread->Yield();
+    while (rwDone < 4)			// RW is in use until they finish
+        currentThread->Yield();
     delete RW;
 }
 
+//----------------------------------------------------------------------
+// ThreadTestInLockPriorityInheritance
+// 	Priority inversion benchmark for the PRIORITY scheduler.  A low
+//	priority thread holds a lock, a high priority thread blocks on it,
+//	and a medium priority thread hogs the CPU in between.  Report how
+//	long the high priority thread waits for the lock, with and
+//	without priority inheritance.
+//----------------------------------------------------------------------
+
+#define PICriticalTicks	200	// OneTicks spent holding the lock
+#define PIMediumTicks	2000	// OneTicks burnt by the medium thread
+
+static Lock *piLock;
+static Semaphore *piGate;	// released by the low thread once it 
+				// holds the lock
+static int piDone;
+
+void PIHigh(int which)
+{
+    piGate->P();
+    int start = stats->totalTicks;
+    piLock->Acquire();
+    int waited = stats->totalTicks - start;
+    piLock->Release();
+    printf("*** high priority thread waited %d ticks for the lock\n", waited);
+    piDone++;
+}
+
+void PIMedium(int which)
+{
+    piGate->P();
+    for (int i = 0; i < PIMediumTicks; i++)
+        interrupt->OneTick();
+    printf("*** medium priority thread finished\n");
+    piDone++;
+}
+
+void PILow(int which)
+{
+    piLock->Acquire();
+    piGate->V();
+    piGate->V();
+    for (int i = 0; i < PICriticalTicks; i++)
+        interrupt->OneTick();
+    piLock->Release();
+    printf("*** low priority thread released the lock\n");
+    piDone++;
+}
+
+static void PIRound(bool inherit)
+{
+    priorityInheritance = inherit;
+    piDone = 0;
+
+    Thread *high = new Thread("pi high", 20);
+    Thread *medium = new Thread("pi medium", 10);
+    Thread *low = new Thread("pi low", 5);
+
+    currentThread->setPri(MAX_PRIORITY);	// fork all three before any runs
+    high->Fork(PIHigh, 0);
+    medium->Fork(PIMedium, 0);
+    low->Fork(PILow, 0);
+
+    currentThread->setPri(0);
+    while (piDone < 3)
+        currentThread->Yield();
+}
+
+void ThreadTestInLockPriorityInheritance()
+{
+    DEBUG('t', "Enter ThreadTestInLockPriorityInheritance");
+
+    bool saved = priorityInheritance;
+    piLock = new Lock("pi lock");
+    piGate = new Semaphore("pi gate", 0);
+
+    printf("With priority inheritance:\n");
+    PIRound(TRUE);
+    printf("Without priority inheritance:\n");
+    PIRound(FALSE);
+
+    priorityInheritance = saved;
+    delete piGate;
+    delete piLock;
+}
+
+//----------------------------------------------------------------------
+// ThreadTestInWokenDonation
+// 	Donation through a thread that has just been woken.  A low 
+//	priority thread holds the outer lock and waits for the inner one,
+//	which the main thread holds.  The main thread releases the inner
+//	lock, which takes the low thread off its queue, and before the low
+//	thread gets to run, a high priority thread blocks on the outer 
+//	lock.  Its donation must stop at the low thread, which is no
+//	longer waiting on anything, rather than look for it on the inner
+//	lock's queue; and it must move the low thread ahead of the main
+//	thread on the ready list, so that both run before the main thread
+//	gets the CPU back.  For the PRIORITY scheduler (--policy 0).
+//----------------------------------------------------------------------
+
+static Lock *dwOuter, *dwInner;
+static Semaphore *dwGate;	// holds the high thread back
+static bool dwWaiting;		// the low thread is about to block
+static int dwDone;
+
+void DWHigh(int which)
+{
+    dwGate->P();
+    dwOuter->Acquire();
+    printf("*** high priority thread got the outer lock\n");
+    dwOuter->Release();
+    dwDone++;
+}
+
+void DWLow(int which)
+{
+    dwOuter->Acquire();
+    dwWaiting = TRUE;
+    dwInner->Acquire();
+    printf("*** low priority thread got the inner lock, at priority %d\n",
+		currentThread->getPri());
+    ASSERT(currentThread->getPri() == 20);	// lent by the high thread
+    ASSERT(dwDone == 0);
+    dwInner->Release();
+    dwDone++;
+    dwOuter->Release();
+}
+
+void ThreadTestInWokenDonation()
+{
+    DEBUG('t', "Enter ThreadTestInWokenDonation");
+    ASSERT(scheduler->getPolicy() == PRIORITY);
+
+    bool saved = priorityInheritance;
+    priorityInheritance = TRUE;
+    dwOuter = new Lock("dw outer");
+    dwInner = new Lock("dw inner");
+    dwGate = new Semaphore("dw gate", 0);
+    dwWaiting = FALSE;
+    dwDone = 0;
+
+    currentThread->setPri(MAX_PRIORITY);	// fork both before either runs
+    dwInner->Acquire();
+    (new Thread("dw high", 20))->Fork(DWHigh, 0);
+    (new Thread("dw low", 5))->Fork(DWLow, 0);
+
+    currentThread->setPri(0);
+    while (!dwWaiting)			// the high thread waits at the
+        currentThread->Yield();		// gate, the low one takes the 
+					// outer lock
+    currentThread->setPri(10);		// above the low thread, so that
+    dwInner->Release();			// it is woken but does not run
+    dwGate->V();
+    ASSERT(currentThread->getPri() == 10);
+    currentThread->Yield();		// the high thread blocks, and the
+    ASSERT(dwDone == 2);		// low one, now at 20, runs first
+    printf("*** donation through a woken thread: ok\n");
+
+    currentThread->setPri(0);
+    priorityInheritance = saved;
+    delete dwGate;
+    delete dwInner;
+    delete dwOuter;
+}
+
+//----------------------------------------------------------------------
+// ThreadTestInStride
+// 	Share accuracy benchmark for the STRIDE scheduler (--policy 3).
+//	Two tenants split the CPU 3:1 by user tickets; the second tenant
+//	splits its quarter 1:3 between two threads by thread tickets.
+//	Every thread burns ticks until StrideTotal ticks have been burnt
+//	in all; every StrideWindow ticks, print each thread's share so 
+//	far against the share its tickets entitle it to.
+//----------------------------------------------------------------------
+
+#define StrideWorkers	3
+#define StrideWindow	2000	// OneTicks between reports
+#define StrideTotal	20000	// OneTicks burnt in all
+
+static const int strideUser[StrideWorkers] = { 1, 2, 2 };
+static const int strideTickets[StrideWorkers] = { 100, 100, 300 };
+static const double strideShare[StrideWorkers] = { 0.75, 0.0625, 0.1875 };
+static int strideRuns[StrideWorkers];
+static int strideTotalRuns;
+
+static void StrideReport()
+{
+    double worst = 0;
+
+    printf("after %5d ticks:", strideTotalRuns);
+    for (int i = 0; i < StrideWorkers; i++) {
+        double share = (double)strideRuns[i] / strideTotalRuns;
+        double error = share > strideShare[i] ? share - strideShare[i]
+                                               : strideShare[i] - share;
+        if (error > worst)
+            worst = error;
+        printf("  t%d %5.2f%% (want %5.2f%%)", i, share * 100, 
+            strideShare[i] * 100);
+    }
+    printf("  max error %.2f%%\n", worst * 100);
+}
+
+void StrideWorker(int which)
+{
+    while (strideTotalRuns < StrideTotal) {
+        interrupt->OneTick();
+        strideRuns[which]++;
+        if (++strideTotalRuns % StrideWindow == 0)
+            StrideReport();
+    }
+}
+
+void ThreadTestInStride()
+{
+    DEBUG('t', "Enter ThreadTestInStride");
+
+    if (scheduler->getPolicy() != STRIDE) {
+        printf("Run with --policy 3 to test the stride scheduler.\n");
+        return;
+    }
+    scheduler->setUserTickets(1, 300);
+    scheduler->setUserTickets(2, 100);
+    strideTotalRuns = 0;
+    for (int i = 0; i < StrideWorkers; i++) {
+        Thread *t = new Thread("stride worker");
+
+        strideRuns[i] = 0;
+        t->setUserID(strideUser[i]);
+        t->setTickets(strideTickets[i]);
+        t->Fork(StrideWorker, (void *)i);
+    }
+}
+
+//----------------------------------------------------------------------
+// ThreadTestInStrideRebase
+// 	Pass overflow test for the STRIDE scheduler (--policy 3).  One 
+//	user's two threads split its time 1:3; the 1-ticket thread's pass
+//	grows by StrideOne a quantum, so it would overflow an int after
+//	RebaseQuanta of them, long before the user's own pass got near.
+//	Run it for twice that, checking that its pass stays in range and
+//	that it still gets its quarter at the end.
+//----------------------------------------------------------------------
+
+#define RebaseQuanta	(0x7fffffff / StrideOne)
+#define RebaseTotal	(2 * 4 * RebaseQuanta * (TimerTicks / SystemTick))
+					// OneTicks burnt in all
+
+static int rebaseRuns[2];
+static int rebaseDone;
+
+void RebaseWorker(int which)
+{
+    while (rebaseRuns[0] + rebaseRuns[1] < RebaseTotal) {
+        interrupt->OneTick();
+        rebaseRuns[which]++;
+        ASSERT(currentThread->getPass() >= 0 
+		&& currentThread->getPass() <= StrideRebaseAt + StrideOne);
+    }
+    if (++rebaseDone < 2)
+        return;
+
+    double share = (double)rebaseRuns[0] / RebaseTotal;
+    printf("1-ticket thread: %d of %d ticks, %.2f%% (want 25.00%%)\n", 
+	rebaseRuns[0], RebaseTotal, share * 100);
+    ASSERT(share > 0.24 && share < 0.26);
+}
+
+void ThreadTestInStrideRebase()
+{
+    DEBUG('t', "Enter ThreadTestInStrideRebase");
+
+    if (scheduler->getPolicy() != STRIDE) {
+        printf("Run with --policy 3 to test the stride scheduler.\n");
+        return;
+    }
+    scheduler->setUserTickets(3, 100);
+    rebaseDone = 0;
+    for (int i = 0; i < 2; i++) {
+        Thread *t = new Thread("rebase worker");
+
+        rebaseRuns[i] = 0;
+        t->setUserID(3);
+        t->setTickets(i == 0 ? 1 : 3);
+        t->Fork(RebaseWorker, (void *)i);
+    }
+}
+
+//----------------------------------------------------------------------
+// ThreadTestInMixedLoad
+// 	Mixed CPU/IO benchmark for the schedulers, MFQ in particular.  CPU
+//	bound threads burn MixCPUTicks in one go; IO bound threads burn
+//	MixBurstTicks, then wait MixIOTicks for a simulated device, 
+//	MixIORounds times.  All arrive at once.  When the last one is done,
+//	print the average response time (arrival to first run) and
+//	turnaround time (arrival to finish) of each class.
+//----------------------------------------------------------------------
+
+#define MixCPUThreads	3
+#define MixIOThreads	3
+#define MixCPUTicks	3000
+#define MixBurstTicks	20
+#define MixIOTicks	300
+#define MixIORounds	10
+
+static int mixArrival;
+static int mixResponse[2], mixTurnaround[2];	// CPU class, IO class
+static int mixDone;
+static Semaphore *mixIODone[MixIOThreads];
+
+static void MixFinish(int kind, int started)
+{
+    mixResponse[kind] += started - mixArrival;
+    mixTurnaround[kind] += stats->totalTicks - mixArrival;
+    if (++mixDone < MixCPUThreads + MixIOThreads)
+        return;
+
+    for (int i = 0; i < MixIOThreads; i++)
+        delete mixIODone[i];		// all the IO has completed
+
+    printf("CPU bound: response %d, turnaround %d ticks on average\n",
+        mixResponse[0] / MixCPUThreads, mixTurnaround[0] / MixCPUThreads);
+    printf("IO bound:  response %d, turnaround %d ticks on average\n",
+        mixResponse[1] / MixIOThreads, mixTurnaround[1] / MixIOThreads);
+}
+
+void MixCPUThread(int which)
+{
+    int started = stats->totalTicks;
+
+    for (int i = 0; i < MixCPUTicks; i++)
+        interrupt->OneTick();
+    MixFinish(0, started);
+}
+
+static void MixIOComplete(int which)
+{
+    mixIODone[which]->V();
+}
+
+void MixIOThread(int which)
+{
+    int started = stats->totalTicks;
+
+    for (int round = 0; round < MixIORounds; round++) {
+        for (int i = 0; i < MixBurstTicks; i++)
+            interrupt->OneTick();
+        IntStatus oldLevel = interrupt->SetLevel(IntOff);
+        interrupt->Schedule(MixIOComplete, which, MixIOTicks, DiskInt);
+        (void) interrupt->SetLevel(oldLevel);
+        mixIODone[which]->P();
+    }
+    MixFinish(1, started);
+}
+
+void ThreadTestInMixedLoad()
+{
+    DEBUG('t', "Enter ThreadTestInMixedLoad");
+
+    mixArrival = stats->totalTicks;
+    mixDone = 0;
+    mixResponse[0] = mixResponse[1] = 0;
+    mixTurnaround[0] = mixTurnaround[1] = 0;
+    for (int i = 0; i < MixCPUThreads; i++)
+        (new Thread("cpu bound"))->Fork(MixCPUThread, (void *)i);
+    for (int i = 0; i < MixIOThreads; i++) {
+        mixIODone[i] = new Semaphore("mix io", 0);
+        (new Thread("io bound"))->Fork(MixIOThread, (void *)i);
+    }
+}
+
+//----------------------------------------------------------------------
+// ThreadTestInMultiCpu
+// 	Scaling benchmark for "-ncpu N".  ScaleThreads threads each burn
+//	ScaleTicks, taking a lock every ScaleLockEvery ticks to update a 
+//	shared counter.  When the last one is done, print how long the
+//	whole batch took; compare runs with N from 1 to 8.
+//----------------------------------------------------------------------
+
+#define ScaleThreads	8
+#define ScaleTicks	2000
+#define ScaleLockEvery	100
+
+static Lock *scaleLock;
+static int scaleCounter;
+static int scaleDone;
+static int scaleStart;
+
+void ScaleThread(int which)
+{
+    for (int i = 1; i <= ScaleTicks; i++) {
+        interrupt->OneTick();
+        if (i % ScaleLockEvery == 0) {
+            scaleLock->Acquire();
+            scaleCounter++;
+            scaleLock->Release();
+        }
+    }
+    if (++scaleDone == ScaleThreads)
+        printf("%d CPUs: %d threads done in %d ticks, counter %d\n",
+            scheduler->getNumCpus(), ScaleThreads, 
+            stats->totalTicks - scaleStart, scaleCounter);
+}
+
+void ThreadTestInMultiCpu()
+{
+    DEBUG('t', "Enter ThreadTestInMultiCpu");
+
+    scaleLock = new Lock("scale lock");
+    scaleCounter = scaleDone = 0;
+    scaleStart = stats->totalTicks;
+    for (int i = 0; i < ScaleThreads; i++)
+        (new Thread("scale"))->Fork(ScaleThread, (void *)i);
+}
+
+//----------------------------------------------------------------------
+// ThreadTestInSwitchRate
+// 	Context switch benchmark.  Two threads hand a token back and forth
+//	through a pair of semaphores SwitchRounds times, so every hand-off
+//	is a switch; print how many switches the host did per second.
+//----------------------------------------------------------------------
+
+#define SwitchRounds	100000
+
+static Semaphore *pingSem, *pongSem;
+static double switchStart;
+static int switchBase;
+
+void PingThread(int which)
+{
+    for (int i = 0; i < SwitchRounds; i++) {
+        pongSem->V();
+        pingSem->P();
+    }
+    double seconds = HostTime() - switchStart;
+    int switches = stats->numContextSwitches - switchBase;
+    printf("%d switches in %.3f host seconds, %.0f per second\n", 
+        switches, seconds, seconds > 0 ? switches / seconds : 0.0);
+}
+
+void PongThread(int which)
+{
+    for (int i = 0; i < SwitchRounds; i++) {
+        pongSem->P();
+        pingSem->V();
+    }
+}
+
+void ThreadTestInSwitchRate()
+{
+    DEBUG('t', "Enter ThreadTestInSwitchRate");
+
+    pingSem = new Semaphore("ping", 0);
+    pongSem = new Semaphore("pong", 0);
+    switchBase = stats->numContextSwitches;
+    switchStart = HostTime();
+    (new Thread("pong"))->Fork(PongThread, (void *)1);
+    (new Thread("ping"))->Fork(PingThread, (void *)0);
+}
+
+//----------------------------------------------------------------------
+// ThreadTestInTickless
+// 	Golden trace for OneTick's short cut.  Threads of different 
+//	priorities spin, hand a semaphore around, and lower their own
+//	priority half way, so ticks see timer interrupts, wake-ups and
+//	preemption.  The trace checksum printed at the end (and at halt)
+//	must be the same with and without "-slowtick", e.g.
+//		nachos -q 17 -rs 7
+//		nachos -q 17 -rs 7 -slowtick
+//	and "-tc" checks every tick that was cut short.
+//----------------------------------------------------------------------
+
+#define TicklessThreads	4
+#define TicklessRounds	2000
+
+static Semaphore *ticklessSem;
+static int ticklessDone;
+
+void TicklessThread(int which)
+{
+    for (int i = 0; i < TicklessRounds; i++) {
+        interrupt->OneTick();
+        if (i % (50 * (which + 1)) == 0) {
+            ticklessSem->V();
+            ticklessSem->P();
+        }
+        if (i == TicklessRounds / 2)
+            currentThread->setPri(which);	// let the others in
+    }
+    if (++ticklessDone == TicklessThreads)
+        printf("tickless: %d ticks, %d cut short; trace %d events, checksum %08x\n",
+            stats->totalTicks, stats->numFastTicks, stats->traceEvents, 
+            stats->traceHash);
+}
+
+void ThreadTestInTickless()
+{
+    DEBUG('t', "Enter ThreadTestInTickless");
+
+    ticklessSem = new Semaphore("tickless", 1);
+    ticklessDone = 0;
+    for (int i = 0; i < TicklessThreads; i++) {
+        Thread *t = new Thread("tickless");
+        t->setPri(MAX_PRIORITY - i);
+        t->Fork(TicklessThread, (void *)i);
+    }
+}
+
 //----------------------------------------------------------------------
 // ThreadTest
 // 	Invoke a test routine.
@@ -350,6 +908,30 @@ ThreadTest()
     case 11:
         ThreadTestInLab3Challenge2();
         break;
+    case 12:
+        ThreadTestInLockPriorityInheritance();
+        break;
+    case 13:
+        ThreadTestInStride();
+        break;
+    case 14:
+        ThreadTestInMixedLoad();
+        break;
+    case 15:
+        ThreadTestInMultiCpu();
+        break;
+    case 16:
+        ThreadTestInSwitchRate();
+        break;
+    case 17:
+        ThreadTestInTickless();
+        break;
+    case 18:
+        ThreadTestInWokenDonation();
+        break;
+    case 19:
+        ThreadTestInStrideRebase();
+        break;
     default:
 	    printf("No test specified.\n");
 	break;
@@ -44,6 +44,8 @@ SwapHeader (NoffHeader *noffH)
 	noffH->uninitData.inFileAddr = WordToHost(noffH->uninitData.inFileAddr);
 }
 
+AddrSpace *AddrSpace::loaded = NULL;
+
 //----------------------------------------------------------------------
 // AddrSpace::AddrSpace
 // 	Create an address space to run a user program.
@@ -105,8 +107,8 @@ AddrSpace::AddrSpace(OpenFile *executable)
 #endif 
 
     char *buffer = new char[size];
-    char fileName[13] = "vm_";
-    char tid[10];
+    char fileName[16] = "vm_";
+    char tid[12];
     sprintf(tid, "%d", currentThread->getTid());
     strcat(fileName, tid);
     fileSystem->Create(fileName, size);
@@ -147,7 +149,8 @@ AddrSpace::AddrSpace(OpenFile *executable)
 
 AddrSpace::~AddrSpace()
 {
-    SaveState();
+    if (loaded == this)			// don't leave the machine pointing
+	SaveState();			// at a dead page table
 #ifdef USE_IPT
     for (int i = 0; i < NumPhysPages; i++)
         if (machine->InvertedPageTable[i].valid && machine->InvertedPageTable[i].tid == currentThread->getTid())
@@ -197,7 +200,9 @@ AddrSpace::InitRegisters()
 // 	On a context switch, save any machine state, specific
 //	to this address space, that needs saving.
 //
-//	For now, nothing!
+//	Write the TLB's dirty bits back to the page table, and invalidate
+//	the TLB.  Only needed when some other address space is about to
+//	be loaded, so RestoreState calls this, not the scheduler.
 //----------------------------------------------------------------------
 
 void AddrSpace::SaveState() 
@@ -214,6 +219,7 @@ void AddrSpace::SaveState()
             machine->tlb[i].valid = false;
         }
     }
+    loaded = NULL;
 }
 
 //----------------------------------------------------------------------
@@ -221,11 +227,20 @@ void AddrSpace::SaveState()
 // 	On a context switch, restore the machine state so that
 //	this address space can run.
 //
-//      For now, tell the machine where to find the page table.
+//      Tell the machine where to find the page table.  If this space
+//	is already loaded -- the previous user thread shares it, or only
+//	kernel threads ran in between -- the TLB is still good, so there
+//	is nothing to do.  Otherwise flush the old space's TLB entries.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState() 
 {
+    if (loaded == this)
+	return;
+    if (loaded != NULL)
+	loaded->SaveState();
+    loaded = this;
+    stats->numSpaceSwitches++;
     machine->pageTable = pageTable;
     machine->pageTableSize = numPages;
 }
@@ -34,6 +34,8 @@ class AddrSpace {
     char *execName;
 
   private:
+    static AddrSpace *loaded;		// whose translations the machine
+					// (TLB and page table) now holds
     TranslationEntry *pageTable;	// Assume linear page table translation
 					// for now!
     unsigned int numPages;		// Number of pages in the virtual 
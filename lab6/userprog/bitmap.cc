@@ -8,6 +8,7 @@
 
 #include "copyright.h"
 #include "bitmap.h"
+#include "disk.h"
 
 //----------------------------------------------------------------------
 // BitMap::BitMap
@@ -22,6 +23,8 @@ BitMap::BitMap(int nitems)
     numBits = nitems;
     numWords = divRoundUp(numBits, BitsInWord);
     map = new unsigned int[numWords];
+    numChunks = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    dirty = new bool[numChunks];
     for (int i = 0; i < numBits; i++) 
         Clear(i);
 }
@@ -34,6 +37,7 @@ BitMap::BitMap(int nitems)
 BitMap::~BitMap()
 { 
     delete map;
+    delete [] dirty;
 }
 
 //----------------------------------------------------------------------
@@ -48,6 +52,7 @@ BitMap::Mark(int which)
 { 
     ASSERT(which >= 0 && which < numBits);
     map[which / BitsInWord] |= 1 << (which % BitsInWord);
+    dirty[which / BitsInWord * sizeof(unsigned) / SectorSize] = TRUE;
 }
     
 //----------------------------------------------------------------------
@@ -62,6 +67,7 @@ BitMap::Clear(int which)
 {
     ASSERT(which >= 0 && which < numBits);
     map[which / BitsInWord] &= ~(1 << (which % BitsInWord));
+    dirty[which / BitsInWord * sizeof(unsigned) / SectorSize] = TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -102,6 +108,28 @@ BitMap::Find()
     return -1;
 }
 
+//----------------------------------------------------------------------
+// BitMap::FindAfter
+// 	Like Find, but look first just after bit "which", and then on up,
+//	wrapping round to bit 0, so that things allocated one after the
+//	other end up next to each other.  -1 for "which" is the same as
+//	Find.
+//----------------------------------------------------------------------
+
+int 
+BitMap::FindAfter(int which) 
+{
+    for (int n = 1; n <= numBits; n++) {
+        int i = (which + n) % numBits;
+
+        if (!Test(i)) {
+            Mark(i);
+            return i;
+        }
+    }
+    return -1;
+}
+
 //----------------------------------------------------------------------
 // BitMap::NumClear
 // 	Return the number of clear bits in the bitmap.
@@ -149,11 +177,16 @@ void
 BitMap::FetchFrom(OpenFile *file) 
 {
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    for (int i = 0; i < numChunks; i++)
+        dirty[i] = FALSE;
 }
 
 //----------------------------------------------------------------------
 // BitMap::WriteBack
-// 	Store the contents of a bitmap to a Nachos file.
+// 	Store the contents of a bitmap to a Nachos file.  Only the sectors
+//	with bits set or cleared since FetchFrom are written, so that a
+//	journaled operation logs just those, not the whole free map; a
+//	new bitmap is written in full.
 //
 //	"file" is the place to write the bitmap to
 //----------------------------------------------------------------------
@@ -161,5 +194,14 @@ BitMap::FetchFrom(OpenFile *file)
 void
 BitMap::WriteBack(OpenFile *file)
 {
-   file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+    int bytes = numWords * sizeof(unsigned);
+
+    for (int i = 0; i < numChunks; i++)
+        if (dirty[i]) {
+            int at = i * SectorSize;
+
+            file->WriteAt((char *)map + at, 
+			(bytes - at < SectorSize) ? bytes - at : SectorSize, at);
+            dirty[i] = FALSE;
+        }
 }
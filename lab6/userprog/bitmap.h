@@ -43,6 +43,8 @@ class BitMap {
     int Find();            	// Return the # of a clear bit, and as a side
 				// effect, set the bit. 
 				// If no bits are clear, return -1.
+    int FindAfter(int which);	// Find, but the first clear bit after
+				// "which", going round to the start
     int NumClear();		// Return the number of clear bits
 
     void Print();		// Print contents of bitmap
@@ -50,7 +52,8 @@ class BitMap {
     // These aren't needed until FILESYS, when we will need to read and 
     // write the bitmap to a file
     void FetchFrom(OpenFile *file); 	// fetch contents from disk 
-    void WriteBack(OpenFile *file); 	// write contents to disk
+    void WriteBack(OpenFile *file); 	// write the sectors of it that
+					// have changed back to disk
 
   private:
     int numBits;			// number of bits in the bitmap
@@ -59,6 +62,8 @@ class BitMap {
 					//  multiple of the number of bits in
 					//  a word)
     unsigned int *map;			// bit storage
+    int numChunks;			// sectors of storage, and which
+    bool *dirty;			// have changed since FetchFrom
 };
 
 #endif // BITMAP_H
@@ -24,6 +24,8 @@
 #include "copyright.h"
 #include "system.h"
 #include "syscall.h"
+#include "synch.h"
+#include "console.h"
 
 struct Message {
     char *fileName;
@@ -35,6 +37,24 @@ void getFilePath(char *path, int addr);
 void execFunc(OpenFile* path);
 void forkFunc(Message* mess);
 
+// Open file ids.  An id is normally an OpenFile *.  Those are word
+// aligned, so the low two bits can tag the other kinds of open file:
+//	ConsoleId			the console
+//	(int)pipe | PipeReadTag		the reading end of a pipe
+//	(int)pipe | PipeWriteTag	the writing end of a pipe
+// ConsoleInput and ConsoleOutput are not ids in their own right; they
+// stand for whatever currentThread->stdIds holds.
+
+#define PipeReadTag	1
+#define PipeWriteTag	3
+#define IdTag(id)	((id) & 3)
+#define PipeOf(id)	((PipeBuffer *)((id) & ~3))
+
+static int RealId(int id);
+static int ShareId(int id);
+static void CloseId(int id);
+static SynchConsole *UserConsole();
+
 
 //----------------------------------------------------------------------
 // ExceptionHandler
@@ -144,8 +164,8 @@ int LRU_LocalPageFrameReplaceHandler() {
         }
 
     if (IsDirty) {
-        char fileName[13] = "vm_";
-        char tid[10];
+        char fileName[16] = "vm_";
+        char tid[12];
         sprintf(tid, "%d", currentThread->getTid());
         strcat(fileName, tid);
         OpenFile *vmOnDisk = fileSystem->Open(fileName);
@@ -176,8 +196,8 @@ int LRU_GlobalPageFrameReplaceHandler() {
         }
 
     if (IsDirty) {
-        char fileName[13] = "vm_";
-        char tid[10];
+        char fileName[16] = "vm_";
+        char tid[12];
 #ifdef USE_IPT
         sprintf(tid, "%d", machine->InvertedPageTable[index].tid);
 #else
@@ -206,8 +226,8 @@ int PageFaultHandler(unsigned int vpn) {
     }
     
     DEBUG('a', "Page Fault: Loading page from disk!");
-    char fileName[13] = "vm_";
-    char tid[10];
+    char fileName[16] = "vm_";
+    char tid[12];
     sprintf(tid, "%d", currentThread->getTid());
     strcat(fileName, tid);
     OpenFile *vmOnDisk = fileSystem->Open(fileName);
@@ -253,13 +273,18 @@ ExceptionHandler(ExceptionType which)
         else
             DEBUG('s', "User program (tid=%d) exit with value %d!\n\n", currentThread->getTid(), exitValue);
 
+        for (int i = 0; i < 2; i++) {		// let go of stdin and stdout
+            CloseId(currentThread->stdIds[i]);
+            currentThread->stdIds[i] = -1;
+        }
+
         if (currentThread->space != NULL) {
             delete currentThread->space;
             currentThread->space = NULL;
         }
 
-        char fileName[13] = "vm_";
-        char tid[10];
+        char fileName[16] = "vm_";
+        char tid[12];
         sprintf(tid, "%d", currentThread->getTid());
         strcat(fileName, tid);
         fileSystem->Remove(fileName);
@@ -297,21 +322,33 @@ ExceptionHandler(ExceptionType which)
         delete [] path;
     }
     else if ((which == SyscallException) && (type == SC_Close)) {
-        OpenFile* openFile = (OpenFile *)machine->ReadRegister(4);
-        DEBUG('s', "Close file with ID %d.\n", int(openFile));
-        delete openFile;
+        int id = machine->ReadRegister(4);
+        DEBUG('s', "Close file with ID %d.\n", id);
+        if (id == ConsoleInput || id == ConsoleOutput) {
+            CloseId(currentThread->stdIds[id]);
+            currentThread->stdIds[id] = -1;
+        } else
+            CloseId(id);
         
         machine->pcIncrease();
     }
     else if ((which == SyscallException) && (type == SC_Read)) {
         int bufferAddr = machine->ReadRegister(4);
         int size = machine->ReadRegister(5);
-        OpenFile* openFile = (OpenFile *)machine->ReadRegister(6);
+        int id = RealId(machine->ReadRegister(6));
 
         char* _buf = new char[size];
-        int readn = openFile->Read(_buf, size);
+        int readn;
+        if (id == ConsoleId)
+            readn = UserConsole()->Read(_buf, size);
+        else if (IdTag(id) == PipeReadTag)
+            readn = PipeOf(id)->Read(_buf, size);
+        else if (id == -1 || IdTag(id) != 0)	// closed, or not readable
+            readn = 0;
+        else
+            readn = ((OpenFile *)id)->Read(_buf, size);
 
-        DEBUG('s', "Read file with ID %d: %s\n", int(openFile), _buf);
+        DEBUG('s', "Read file with ID %d: %d bytes\n", id, readn);
 
         for (int i = 0; i < readn; i++)
             while(!machine->WriteMem(bufferAddr + i, 1, (int)_buf[i]))
@@ -324,16 +361,21 @@ ExceptionHandler(ExceptionType which)
     else if ((which == SyscallException) && (type == SC_Write)) {
         int bufferAddr = machine->ReadRegister(4);
         int size = machine->ReadRegister(5);
-        OpenFile* openFile = (OpenFile *)machine->ReadRegister(6);
+        int id = RealId(machine->ReadRegister(6));
 
         char* _buf = new char[size];
         for (int i = 0; i < size; i++)
             while(!machine->ReadMem(bufferAddr + i, 1, (int *)(_buf + i)))
                 ;
 
-        DEBUG('s', "Write file with ID %d: %s\n", int(openFile), _buf);
+        DEBUG('s', "Write file with ID %d: %d bytes\n", id, size);
 
-        openFile->Write(_buf, size);
+        if (id == ConsoleId)
+            UserConsole()->Write(_buf, size);
+        else if (IdTag(id) == PipeWriteTag)
+            PipeOf(id)->Write(_buf, size);
+        else if (id != -1 && IdTag(id) == 0)
+            ((OpenFile *)id)->Write(_buf, size);
         machine->pcIncrease();
 
         delete [] _buf;
@@ -347,6 +389,8 @@ ExceptionHandler(ExceptionType which)
 
         Thread* newThread = new Thread("ExecThread");
         OpenFile *executable = fileSystem->Open(path);
+        for (int i = 0; i < 2; i++)		// inherit stdin and stdout
+            newThread->stdIds[i] = ShareId(currentThread->stdIds[i]);
         newThread->Fork((VoidFunctionPtr)execFunc, (void *)executable);
 
         DEBUG('s', "Execute %s: %d\n", path, newThread->getTid());
@@ -362,6 +406,8 @@ ExceptionHandler(ExceptionType which)
         mess->fileName = currentThread->space->execName;
         mess->func = funcAddr;
         Thread* newThread = new Thread("ForkThread");
+        for (int i = 0; i < 2; i++)
+            newThread->stdIds[i] = ShareId(currentThread->stdIds[i]);
         newThread->Fork((VoidFunctionPtr)forkFunc, (void *)mess);
 
         machine->pcIncrease();
@@ -372,9 +418,45 @@ ExceptionHandler(ExceptionType which)
 
         machine->pcIncrease();
     }
+    else if ((which == SyscallException) && (type == SC_Pipe)) {
+        int endsAddr = machine->ReadRegister(4);
+        PipeBuffer *pipe = new PipeBuffer("user pipe", PipeSize);
+
+        pipe->Open(FALSE);
+        pipe->Open(TRUE);
+        while(!machine->WriteMem(endsAddr, 4, int(pipe) | PipeReadTag))
+            ;
+        while(!machine->WriteMem(endsAddr + 4, 4, int(pipe) | PipeWriteTag))
+            ;
+        DEBUG('s', "PipeBuffer: %d\n", int(pipe));
+
+        machine->pcIncrease();
+    }
+    else if ((which == SyscallException) && (type == SC_Dup)) {
+        int id = RealId(machine->ReadRegister(4));
+        int dup;
+
+        if (id == -1 || IdTag(id) == 0)		// closed, or a plain file
+            dup = -1;
+        else {
+            dup = ShareId(id);
+            for (int i = 0; i < 2; i++)		// fill a closed stdin/stdout
+                if (currentThread->stdIds[i] == -1) {
+                    currentThread->stdIds[i] = dup;
+                    dup = i;
+                    break;
+                }
+        }
+        DEBUG('s', "Dup: %d -> %d\n", id, dup);
+        machine->WriteRegister(2, dup);
+
+        machine->pcIncrease();
+    }
     else if ((which == SyscallException) && (type == SC_Join)) {
         int waitTid = machine->ReadRegister(4);
-        while (Thread::getPtrVec()[waitTid])
+        if (threadTable->Lookup(waitTid) == NULL)	// stale or bogus tid
+            DEBUG('s', "Join: %d is not a live thread\n", waitTid);
+        while (threadTable->Lookup(waitTid) != NULL)
             currentThread->Yield();
         DEBUG('s', "Join: %d\n", waitTid);
 
@@ -438,11 +520,71 @@ void getFilePath(char *path, int addr) {
     return;
 }
 
+//----------------------------------------------------------------------
+// RealId
+// 	What open file id "id" refers to: ConsoleInput and ConsoleOutput 
+//	stand for the current thread's standard input and output.
+//----------------------------------------------------------------------
+
+static int RealId(int id) {
+    if (id == ConsoleInput || id == ConsoleOutput)
+        return currentThread->stdIds[id];
+    return id;
+}
+
+//----------------------------------------------------------------------
+// ShareId
+// 	Take one more reference to the open file "id" (not a plain file,
+//	those are not reference counted), and return it.
+//----------------------------------------------------------------------
+
+static int ShareId(int id) {
+    if (IdTag(id) == PipeReadTag || IdTag(id) == PipeWriteTag)
+        PipeOf(id)->Open(IdTag(id) == PipeWriteTag);
+    return id;
+}
+
+//----------------------------------------------------------------------
+// CloseId
+// 	Drop a reference to the open file "id".  A pipe goes away when
+//	both of its ends are closed everywhere.
+//----------------------------------------------------------------------
+
+static void CloseId(int id) {
+    if (id == -1 || id == ConsoleId)
+        return;
+    if (IdTag(id) == PipeReadTag || IdTag(id) == PipeWriteTag) {
+        PipeBuffer *pipe = PipeOf(id);
+        pipe->Close(IdTag(id) == PipeWriteTag);
+        if (pipe->IsClosed())
+            delete pipe;
+    } else
+        delete (OpenFile *)id;
+}
+
+//----------------------------------------------------------------------
+// UserConsole
+// 	Return the console that user programs read and write, starting 
+//	it the first time.  Until its input runs out, the console keeps 
+//	polling the keyboard, so Nachos does not halt just because it is 
+//	idle; programs that use the console should call Halt.
+//----------------------------------------------------------------------
+
+static SynchConsole *userConsole = NULL;
+
+static SynchConsole *UserConsole() {
+    if (userConsole == NULL)
+        userConsole = new SynchConsole(NULL, NULL);
+    return userConsole;
+}
+
 void execFunc(OpenFile* executable) {
     AddrSpace* space;
 
     if (executable == NULL) {
         printf("Unable to open file\n");
+        for (int i = 0; i < 2; i++)
+            CloseId(currentThread->stdIds[i]);
         return;
     }
     space = new AddrSpace(executable);    
@@ -463,6 +605,8 @@ void forkFunc(Message* mess) {
 
     if (executable == NULL) {
         printf("Unable to open file\n");
+        for (int i = 0; i < 2; i++)
+            CloseId(currentThread->stdIds[i]);
         return;
     }
     space = new AddrSpace(executable);    
@@ -29,6 +29,8 @@
 #define SC_Close	8
 #define SC_Fork		9
 #define SC_Yield	10
+#define SC_Pipe		11
+#define SC_Dup		12
 
 #ifndef IN_ASM
 
@@ -108,6 +110,22 @@ int Read(char *buffer, int size, OpenFileId id);
 /* Close the file, we're done reading and writing to it. */
 void Close(OpenFileId id);
 
+/* Make a pipe: bytes written to ends[1] can be read from ends[0].
+ * Reading an empty pipe waits for data, and returns 0 once every 
+ * writing end has been closed; writing a full pipe waits for room.
+ */
+void Pipe(OpenFileId ends[2]);
+
+/* Return another id for what "id" refers to; the object stays open 
+ * until every id for it is closed.  If ConsoleInput or ConsoleOutput
+ * has been closed, the new id is that one (lowest first), as in UNIX;
+ * this is how a shell points a program's standard input or output at 
+ * a pipe before Exec'ing it.  Programs Exec'ed inherit what their
+ * parent's ConsoleInput and ConsoleOutput refer to.  Only the console
+ * and pipes can be duplicated; for other files this returns -1.
+ */
+OpenFileId Dup(OpenFileId id);
+
 
 
 /* User-level thread operations: Fork and Yield.  To allow multiple